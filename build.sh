@@ -2,6 +2,14 @@
 
 make ${MAKE_OPTS:-} -C src/kernel kernel.elf
 
+# 共有ランタイムには全アプリが参照するライブラリ関数を集めるので，
+# 先に各アプリのオブジェクトファイルを作っておく
+for MK in $(grep -l Makefile.elfapp src/apps/*/Makefile)
+do
+  make ${MAKE_OPTS:-} -C $(dirname $MK) objs
+done
+make ${MAKE_OPTS:-} -C src/apps/runtime runtime
+
 for MK in $(ls src/apps/*/Makefile)
 do
   APP_DIR=$(dirname $MK)
@@ -8,6 +8,8 @@
 #include  <Protocol/SimpleFileSystem.h>
 #include  <Protocol/DiskIo2.h>
 #include  <Protocol/BlockIo.h>
+#include  <Protocol/DevicePath.h>
+#include  <Protocol/PciIo.h>
 #include  <Guid/FileInfo.h>
 
 #include  "frame_buffer_config.hpp"
@@ -243,6 +245,59 @@ EFI_STATUS OpenBlockIoProtocolForLoadedImage(
   return status;
 }
 
+BOOLEAN BootDeviceIsVirtioBlock(EFI_HANDLE image_handle) {
+  EFI_STATUS status;
+  EFI_LOADED_IMAGE_PROTOCOL* loaded_image;
+  EFI_DEVICE_PATH_PROTOCOL* device_path;
+  EFI_HANDLE pci_handle;
+  EFI_PCI_IO_PROTOCOL* pci_io;
+  UINT16 ids[2];
+
+  status = gBS->OpenProtocol(
+    image_handle,
+    &gEfiLoadedImageProtocolGuid,
+    (VOID**)&loaded_image,
+    image_handle,
+    NULL,
+    EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
+  if (EFI_ERROR(status)) {
+    return FALSE;
+  }
+
+  status = gBS->OpenProtocol(
+    loaded_image->DeviceHandle,
+    &gEfiDevicePathProtocolGuid,
+    (VOID**)&device_path,
+    image_handle,
+    NULL,
+    EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
+  if (EFI_ERROR(status)) {
+    return FALSE;
+  }
+
+  status = gBS->LocateDevicePath(&gEfiPciIoProtocolGuid, &device_path, &pci_handle);
+  if (EFI_ERROR(status)) {
+    return FALSE;
+  }
+
+  status = gBS->OpenProtocol(
+    pci_handle,
+    &gEfiPciIoProtocolGuid,
+    (VOID**)&pci_io,
+    image_handle,
+    NULL,
+    EFI_OPEN_PROTOCOL_BY_HANDLE_PROTOCOL);
+  if (EFI_ERROR(status)) {
+    return FALSE;
+  }
+
+  status = pci_io->Pci.Read(pci_io, EfiPciIoWidthUint16, 0, 2, ids);
+  if (EFI_ERROR(status)) {
+    return FALSE;
+  }
+  return ids[0] == 0x1af4 && ids[1] == 0x1001;
+}
+
 EFI_STATUS ReadBlocks(
   EFI_BLOCK_IO_PROTOCOL* block_io, UINT32 media_id,
   UINTN read_bytes, VOID** buffer) {
@@ -354,7 +409,7 @@ EFI_STATUS EFIAPI UefiMain(
     Halt();
   }
 
-  VOID* volume_image;
+  VOID* volume_image = NULL;
 
   EFI_FILE_PROTOCOL* volume_file;
   status = root_dir->Open(
@@ -366,6 +421,8 @@ EFI_STATUS EFIAPI UefiMain(
       Print(L"failed to read volume file: %r", status);
       Halt();
     }
+  } else if (BootDeviceIsVirtioBlock(image_handle)) {
+    Print(L"Boot volume is virtio-blk: the kernel reads it on demand\n");
   } else {
     EFI_BLOCK_IO_PROTOCOL* block_io;
     status = OpenBlockIoProtocolForLoadedImage(image_handle, &block_io);
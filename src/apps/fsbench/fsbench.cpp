@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../syscall.h"
+
+namespace {
+  // ボリュームのルートを汚さないよう，測定用のファイルはこのディレクトリに作る
+  const char* const kScratchDir = "/FSBENCH";
+  const char* const kSeqFile = "/FSBENCH/SEQ.DAT";
+  const int kMaxFiles = 1000;
+
+  void FilePath(char* path, int i) {
+    sprintf(path, "%s/FB%03d.DAT", kScratchDir, i % kMaxFiles);
+  }
+
+  void MakeScratchDir() {
+    if (mkdir(kScratchDir, 0) < 0 && errno != EEXIST) {
+      fprintf(stderr, "failed to create %s\n", kScratchDir);
+      exit(1);
+    }
+  }
+
+  // 作ったファイルとディレクトリを消す．途中で失敗したときも呼ぶ
+  void RemoveScratchDir(int num_files) {
+    unlink(kSeqFile);
+    for (int i = 0; i < num_files && i < kMaxFiles; ++i) {
+      char path[32];
+      FilePath(path, i);
+      unlink(path);
+    }
+    if (rmdir(kScratchDir) < 0) {
+      fprintf(stderr, "failed to remove %s\n", kScratchDir);
+    }
+  }
+
+  [[noreturn]] void Fail(const char* what, const char* path, int num_files) {
+    fprintf(stderr, "failed to %s %s\n", what, path);
+    RemoveScratchDir(num_files);
+    exit(1);
+  }
+
+  unsigned long ElapsedMS(unsigned long tick_start, unsigned long timer_freq) {
+    return (SyscallGetCurrentTick().value - tick_start) * 1000 / timer_freq;
+  }
+
+  unsigned long KiBPerSec(size_t bytes, unsigned long ms) {
+    return ms ? bytes * 1000 / 1024 / ms : 0;
+  }
+
+  // 1 つの大きなファイルへ順に書き込み，書き込みと fsync の時間を分けて測る
+  void SequentialWrite(int mib) {
+    static char buf[64 * 1024];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+      buf[i] = 'a' + i % 26;
+    }
+
+    const int fd = open(kSeqFile, O_WRONLY | O_CREAT);
+    if (fd < 0) {
+      Fail("open", kSeqFile, 0);
+    }
+
+    auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+    const size_t total_bytes = static_cast<size_t>(mib) * 1024 * 1024;
+    for (size_t written = 0; written < total_bytes; written += sizeof(buf)) {
+      if (write(fd, buf, sizeof(buf)) <= 0) {
+        close(fd);
+        Fail("write", kSeqFile, 0);
+      }
+    }
+    const auto write_ms = ElapsedMS(tick_start, timer_freq);
+
+    auto tick_sync = SyscallGetCurrentTick().value;
+    if (fsync(fd) < 0) {
+      close(fd);
+      Fail("fsync", kSeqFile, 0);
+    }
+    const auto sync_ms = ElapsedMS(tick_sync, timer_freq);
+
+    printf("write %d MiB: %lu ms (%lu KiB/s), fsync: %lu ms (%lu KiB/s)\n",
+           mib, write_ms, KiBPerSec(total_bytes, write_ms),
+           sync_ms, KiBPerSec(total_bytes, sync_ms));
+    close(fd);
+  }
+}
+
+// 引数なし，または数値: 大きさの異なるファイルを多数書き込み，クラスタ確保を含む書き込み性能を測る
+// seq [MiB]: 大きなファイルを順に書き込み，ディスクへの書き戻しを含めた性能を測る
+extern "C" void main(int argc, char** argv) {
+  MakeScratchDir();
+  if (argc >= 2 && strcmp(argv[1], "seq") == 0) {
+    SequentialWrite(argc >= 3 ? atoi(argv[2]) : 16);
+    RemoveScratchDir(0);
+    exit(0);
+  }
+
+  int num_files = 1000;
+  if (argc >= 2) {
+    num_files = atoi(argv[1]);
+  }
+
+  static const size_t kSizes[] = {100, 700, 1500, 4096, 9000, 24000, 60000};
+  static char buf[60000];
+  for (size_t i = 0; i < sizeof(buf); ++i) {
+    buf[i] = 'a' + i % 26;
+  }
+
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  size_t total_bytes = 0;
+
+  for (int i = 0; i < num_files; ++i) {
+    char path[32];
+    FilePath(path, i);
+    const int fd = open(path, O_WRONLY | O_CREAT);
+    if (fd < 0) {
+      Fail("open", path, i);
+    }
+
+    // 小さな write を繰り返し，追記によるチェーンの伸長も測る
+    const size_t size = kSizes[i % (sizeof(kSizes) / sizeof(kSizes[0]))];
+    size_t written = 0;
+    while (written < size) {
+      const size_t n = size - written < 4096 ? size - written : 4096;
+      const ssize_t w = write(fd, &buf[written], n);
+      if (w <= 0) {
+        close(fd);
+        Fail("write", path, i + 1);
+      }
+      written += w;
+    }
+    close(fd);
+    total_bytes += written;
+  }
+
+  const auto elapsed_ms = ElapsedMS(tick_start, timer_freq);
+  printf("%d files, %lu bytes in %lu ms (%lu KiB/s)\n",
+         num_files, total_bytes, elapsed_ms, KiBPerSec(total_bytes, elapsed_ms));
+  RemoveScratchDir(num_files);
+  exit(0);
+}
@@ -78,23 +78,24 @@ extern "C" void main(int argc, char** argv) {
 
   const char* last_slash = strrchr(filepath, '/');
   const char* filename = last_slash ? &last_slash[1] : filepath;
-  SyscallResult window =
-    SyscallOpenWindow(8 + width, 28 + height, 10, 10, filename);
+  AppWindowSurface surface;
+  SyscallResult window = SyscallOpenWindowSurface(
+      8 + width, 28 + height, 10, 10, filename, &surface);
   if (window.error) {
     fprintf(stderr, "%s\n", strerror(window.error));
     exit(1);
   }
   const uint64_t layer_id = window.value;
 
+  // 描画面に直接書き込み，最後に全体を 1 回だけ反映する
   for (int y = 0; y < height; ++y) {
+    uint32_t* line = &surface.pixels[y * surface.width];
     for (int x = 0; x < width; ++x) {
-      uint32_t c = get_color(&image_data[bytes_per_pixel * (y * width + x)]);
-      SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                              4 + x, 24 + y, 1, 1, c);
+      line[x] = get_color(&image_data[bytes_per_pixel * (y * width + x)]);
     }
   }
 
-  SyscallWinRedraw(layer_id);
+  SyscallWinCommit(layer_id, 0, 0, width, height);
   WaitEvent();
 
   SyscallCloseWindow(layer_id);
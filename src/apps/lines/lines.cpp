@@ -28,12 +28,16 @@ extern "C" void main(int argc, char** argv) {
     exit(err_openwin);
   }
 
+  // 全線分を配列にまとめ，1 回のシステムコールで描画する
+  AppLine lines[2 * (90 / 5 + 1)];
+  size_t num_lines = 0;
   const int x0 = 4, y0 = 24, x1 = 4 + kRadius + 10, y1 = 24 + kRadius;
   for (int deg = 0; deg <= 90; deg += 5) {
     const int x = kRadius * cos(M_PI * deg / 180.0);
     const int y = kRadius * sin(M_PI * deg / 180.0);
-    SyscallWinDrawLine(layer_id, x0, y0, x0 + x, y0 + y, Color(deg));
-    SyscallWinDrawLine(layer_id, x1, y1, x1 + x, y1 - y, Color(deg + 90));
+    lines[num_lines++] = {x0, y0, x0 + x, y0 + y, Color(deg)};
+    lines[num_lines++] = {x1, y1, x1 + x, y1 - y, Color(deg + 90)};
   }
+  SyscallWinDrawLines(layer_id, lines, num_lines);
   exit(0);
 }
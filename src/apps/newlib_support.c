@@ -2,9 +2,53 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdint.h>
+#include <string.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <time.h>
 
 #include "syscall.h"
+#include "thread.h"
+
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 4
+#endif
+
+static volatile const struct AppSysInfo* const sysinfo =
+  (volatile const struct AppSysInfo*)kAppSysInfoAddr;
+
+struct SyscallResult SyscallGetCurrentTick() {
+  struct SyscallResult res = { sysinfo->tick, (int)sysinfo->timer_freq };
+  return res;
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec* tp) {
+  if (clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // TSC が使えればそれで，使えなければ tick の分解能で計時する．
+  uint64_t sec, nsec;
+  const uint64_t tsc_freq = sysinfo->tsc_freq;
+  if (tsc_freq != 0) {
+    const uint64_t delta = __builtin_ia32_rdtsc() - sysinfo->tsc_base;
+    sec = delta / tsc_freq;
+    nsec = (delta % tsc_freq) * 1000000000 / tsc_freq;
+  } else {
+    const uint64_t tick = sysinfo->tick;
+    const uint64_t freq = sysinfo->timer_freq;
+    sec = tick / freq;
+    nsec = (tick % freq) * 1000000000 / freq;
+  }
+
+  if (clock_id == CLOCK_REALTIME) {
+    sec += sysinfo->realtime_base;
+  }
+  tp->tv_sec = sec;
+  tp->tv_nsec = nsec;
+  return 0;
+}
 
 int close(int fd) {
   errno = EBADF;
@@ -12,6 +56,16 @@ int close(int fd) {
 }
 
 int fstat(int fd, struct stat* buf) {
+  // 標準入出力は端末かパイプにつながるキャラクタデバイスとして見せる．
+  // newlib は isatty が 1 を返せば行バッファリングにするので，端末への出力はすぐ現れる．
+  // パイプへの出力は st_blksize を大きめに返すことでバッファが大きくなり，
+  // SyscallPutString の呼び出し回数が減る．
+  if (0 <= fd && fd <= 2) {
+    memset(buf, 0, sizeof(*buf));
+    buf->st_mode = S_IFCHR;
+    buf->st_blksize = 16384;
+    return 0;
+  }
   errno = EBADF;
   return -1;
 }
@@ -20,11 +74,28 @@ pid_t getpid(void) {
   return 0;
 }
 
-int isatty(int fd) {
-  errno = EBADF;
+int fsync(int fd) {
+  struct SyscallResult res = SyscallFsync(fd);
+  if (res.error == 0) {
+    return 0;
+  }
+  errno = res.error;
   return -1;
 }
 
+int isatty(int fd) {
+  struct SyscallResult res = SyscallIsTerminal(fd);
+  if (res.error) {
+    errno = res.error;
+    return 0;
+  }
+  if (res.value == 0) {
+    errno = ENOTTY;
+    return 0;
+  }
+  return 1;
+}
+
 int kill(pid_t pid, int sig) {
   errno = EPERM;
   return -1;
@@ -35,6 +106,15 @@ off_t lseek(int fd, off_t offset, int whence) {
   return -1;
 }
 
+int mkdir(const char* path, mode_t mode) {
+  struct SyscallResult res = SyscallMakeDirectory(path);
+  if (res.error == 0) {
+    return 0;
+  }
+  errno = res.error;
+  return -1;
+}
+
 int open(const char* path, int flags) {
   struct SyscallResult res = SyscallOpenFile(path, flags);
   if (res.error == 0) {
@@ -63,6 +143,15 @@ ssize_t read(int fd, void* buf, size_t count) {
   return -1;
 }
 
+int rmdir(const char* path) {
+  struct SyscallResult res = SyscallRemoveFile(path);
+  if (res.error == 0) {
+    return 0;
+  }
+  errno = res.error;
+  return -1;
+}
+
 caddr_t sbrk(int incr) {
   static uint64_t dpage_end = 0;
   static uint64_t program_break = 0;
@@ -83,6 +172,15 @@ caddr_t sbrk(int incr) {
   return (caddr_t)prev_break;
 }
 
+int unlink(const char* path) {
+  struct SyscallResult res = SyscallRemoveFile(path);
+  if (res.error == 0) {
+    return 0;
+  }
+  errno = res.error;
+  return -1;
+}
+
 ssize_t write(int fd, const void* buf, size_t count) {
   struct SyscallResult res = SyscallPutString(fd, buf, count);
   if (res.error == 0) {
@@ -95,3 +193,120 @@ ssize_t write(int fd, const void* buf, size_t count) {
 void _exit(int status) {
   SyscallExit(status);
 }
+
+// ThreadCreate で 1 つでもスレッドを作ったら 1 になる．
+// それまでは malloc のロックを省く
+static int multithreaded = 0;
+
+struct ThreadStartInfo {
+  void (*func)(void*);
+  void* arg;
+};
+
+static void ThreadStart(int unused, void* p) {
+  struct ThreadStartInfo* info = p;
+  void (*func)(void*) = info->func;
+  void* arg = info->arg;
+  free(info);
+
+  func(arg);
+  SyscallExit(0);
+}
+
+int ThreadCreate(void (*func)(void*), void* arg) {
+  struct ThreadStartInfo* info = malloc(sizeof(*info));
+  if (!info) {
+    errno = ENOMEM;
+    return -1;
+  }
+  info->func = func;
+  info->arg = arg;
+
+  multithreaded = 1;
+  struct SyscallResult res = SyscallThreadCreate(ThreadStart, info);
+  if (res.error) {
+    free(info);
+    errno = res.error;
+    return -1;
+  }
+  return res.value;
+}
+
+int ThreadJoin(int thread_id) {
+  struct SyscallResult res = SyscallThreadJoin(thread_id);
+  if (res.error) {
+    errno = res.error;
+    return -1;
+  }
+  return 0;
+}
+
+void MutexLock(struct Mutex* m) {
+  uint32_t c = 0;
+  if (__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return;
+  }
+  // 待つスレッドがいることを示す 2 にしてから眠る
+  if (c != 2) {
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+  while (c != 0) {
+    SyscallFutexWait(&m->state, 2, -1);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void MutexUnlock(struct Mutex* m) {
+  // 1 から下ろしたのなら待っているスレッドはいないので，システムコールは要らない
+  if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1) {
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    SyscallFutexWake(&m->state, 1);
+  }
+}
+
+void CondWait(struct Cond* c, struct Mutex* m) {
+  const uint32_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+  MutexUnlock(m);
+  SyscallFutexWait(&c->seq, seq, -1);
+  MutexLock(m);
+}
+
+void CondSignal(struct Cond* c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  SyscallFutexWake(&c->seq, 1);
+}
+
+void CondBroadcast(struct Cond* c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  SyscallFutexWake(&c->seq, SIZE_MAX);
+}
+
+// newlib の malloc は内部で自分を呼ぶことがあるので，同じスレッドなら再びロックできるようにする
+static struct Mutex malloc_mutex;
+static uint64_t malloc_owner;
+static int malloc_depth;
+
+void __malloc_lock(struct _reent* r) {
+  if (!multithreaded) {
+    return;
+  }
+  const uint64_t self = SyscallThreadSelf().value;
+  if (malloc_owner == self) {
+    ++malloc_depth;
+    return;
+  }
+  MutexLock(&malloc_mutex);
+  malloc_owner = self;
+  malloc_depth = 1;
+}
+
+void __malloc_unlock(struct _reent* r) {
+  if (!multithreaded) {
+    return;
+  }
+  if (--malloc_depth == 0) {
+    malloc_owner = 0;
+    MutexUnlock(&malloc_mutex);
+  }
+}
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../syscall.h"
+
+// 標準入力を読みながらウィンドウのイベントとタイマも受け付ける例
+// 読んだバイト数と経過秒数をウィンドウに表示し，入力の終わりかウィンドウを閉じると終了する
+namespace {
+  const int kTimerValue = 1;
+
+  void Draw(uint64_t layer_id, size_t bytes, int seconds) {
+    char s[32];
+    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW, 4, 24, 192, 40, 0xffffff);
+    sprintf(s, "%lu bytes", bytes);
+    SyscallWinWriteString(layer_id | LAYER_NO_REDRAW, 8, 28, 0x000000, s);
+    sprintf(s, "%d sec", seconds);
+    SyscallWinWriteString(layer_id, 8, 44, 0x000000, s);
+  }
+}
+
+extern "C" void main(int argc, char** argv) {
+  auto [layer_id, err_openwin]
+    = SyscallOpenWindow(200, 72, 10, 10, "pollcat");
+  if (err_openwin) {
+    exit(err_openwin);
+  }
+
+  size_t bytes = 0;
+  int seconds = 0;
+  Draw(layer_id, bytes, seconds);
+  SyscallCreateTimer(TIMER_ONESHOT_REL, kTimerValue, 1000);
+
+  AppPollFd fds[2] = {
+    {0, kAppPollIn, 0},
+    {kAppPollEvents, kAppPollIn, 0},
+  };
+  bool eof = false;
+  while (!eof) {
+    if (auto [ n, err ] = SyscallPoll(fds, 2, -1); err) {
+      fprintf(stderr, "Poll failed: %s\n", strerror(err));
+      break;
+    }
+
+    if (fds[0].revents & kAppPollIn) {
+      char buf[256];
+      auto [ n, err ] = SyscallReadFile(0, buf, sizeof(buf));
+      if (err || n == 0) {
+        eof = true;
+      } else {
+        SyscallPutString(1, buf, n);
+        bytes += n;
+        Draw(layer_id, bytes, seconds);
+      }
+    }
+
+    if (fds[1].revents & kAppPollIn) {
+      AppEvent events[8];
+      auto [ n, err ] = SyscallReadEvent(events, 8);
+      for (size_t i = 0; i < n; ++i) {
+        if (events[i].type == AppEvent::kQuit) {
+          eof = true;
+        } else if (events[i].type == AppEvent::kTimerTimeout) {
+          Draw(layer_id, bytes, ++seconds);
+          SyscallCreateTimer(TIMER_ONESHOT_REL, kTimerValue, 1000);
+        }
+      }
+    }
+  }
+
+  SyscallCloseWindow(layer_id);
+  exit(0);
+}
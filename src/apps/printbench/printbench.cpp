@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../syscall.h"
+
+// 引数なし: printf で大量の行を出力する
+// 引数 "-": 標準入力を読み捨て，受け取った量を数える（パイプの帯域測定用）
+// それ以外の引数: 指定されたファイルの内容を標準出力へ書き出す（cat 相当）
+extern "C" void main(int argc, char** argv) {
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+  size_t total_bytes = 0;
+
+  if (argc >= 2 && strcmp(argv[1], "-") == 0) {
+    static char buf[16384];
+    while (true) {
+      const ssize_t n = read(0, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      total_bytes += n;
+    }
+  } else if (argc >= 2) {
+    const int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "failed to open: %s\n", argv[1]);
+      exit(1);
+    }
+    static char buf[16384];
+    while (true) {
+      const ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      write(1, buf, n);
+      total_bytes += n;
+    }
+  } else {
+    for (int i = 0; i < 20000; ++i) {
+      total_bytes += printf("line %5d: the quick brown fox jumps over the lazy dog\n", i);
+    }
+    fflush(stdout);
+  }
+
+  auto tick_end = SyscallGetCurrentTick();
+  const unsigned long elapsed_ms =
+    (tick_end.value - tick_start) * 1000 / timer_freq;
+  fprintf(stderr, "%lu bytes in %lu ms (%lu KiB/s)\n",
+          total_bytes, elapsed_ms,
+          elapsed_ms ? total_bytes * 1000 / 1024 / elapsed_ms : 0);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../syscall.h"
+#include "../thread.h"
+
+// 乱数列を区間に分けてスレッドごとにソートし，最後に併合する
+// 引数: [要素数（省略時 1000000）] [スレッド数（省略時 4）]
+namespace {
+  struct Chunk {
+    int* begin;
+    int* end;
+  };
+
+  // 終わったスレッドの数．main はこれが揃うのを条件変数で待つ
+  Mutex done_mutex;
+  Cond done_cond;
+  int num_done = 0;
+
+  void SortChunk(void* arg) {
+    auto chunk = reinterpret_cast<Chunk*>(arg);
+    std::sort(chunk->begin, chunk->end);
+
+    MutexLock(&done_mutex);
+    ++num_done;
+    CondSignal(&done_cond);
+    MutexUnlock(&done_mutex);
+  }
+
+  unsigned long ElapsedMS(unsigned long tick_start, unsigned long timer_freq) {
+    return (SyscallGetCurrentTick().value - tick_start) * 1000 / timer_freq;
+  }
+}
+
+extern "C" void main(int argc, char** argv) {
+  const size_t num = argc >= 2 ? atoi(argv[1]) : 1000000;
+  const int num_threads = argc >= 3 ? atoi(argv[2]) : 4;
+  if (num == 0 || num_threads <= 0 || num_threads > 64) {
+    fprintf(stderr, "invalid arguments\n");
+    exit(1);
+  }
+
+  std::vector<int> data(num);
+  for (auto& v : data) {
+    v = rand();
+  }
+
+  auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+
+  std::vector<Chunk> chunks(num_threads);
+  std::vector<int> thread_ids;
+  for (int i = 0; i < num_threads; ++i) {
+    chunks[i] = {&data[num * i / num_threads], &data[0] + num * (i + 1) / num_threads};
+    const int id = ThreadCreate(SortChunk, &chunks[i]);
+    if (id < 0) {
+      fprintf(stderr, "failed to create thread\n");
+      exit(1);
+    }
+    thread_ids.push_back(id);
+  }
+
+  MutexLock(&done_mutex);
+  while (num_done < num_threads) {
+    CondWait(&done_cond, &done_mutex);
+  }
+  MutexUnlock(&done_mutex);
+  for (auto id : thread_ids) {
+    ThreadJoin(id);
+  }
+  const auto sort_ms = ElapsedMS(tick_start, timer_freq);
+
+  for (int i = 1; i < num_threads; ++i) {
+    std::inplace_merge(&data[0], chunks[i].begin, chunks[i].end);
+  }
+  const auto total_ms = ElapsedMS(tick_start, timer_freq);
+
+  if (!std::is_sorted(data.begin(), data.end())) {
+    fprintf(stderr, "not sorted!\n");
+    exit(1);
+  }
+  printf("%lu elements, %d threads: sort %lu ms, total %lu ms\n",
+         num, num_threads, sort_ms, total_ms);
+  exit(0);
+}
@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../syscall.h"
+
+// ファイルを小さな単位で読み，1 回ずつ read するのと I/O リングでまとめて投入するのを比べる
+// 引数: ファイル名 [1 回に読むバイト数（省略時 512）]
+namespace {
+  const uint32_t kRingEntries = 64;
+
+  inline uint64_t ReadTSC() {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return static_cast<uint64_t>(hi) << 32 | lo;
+  }
+
+  struct Ring {
+    AppRing* header;
+    AppRingSQE* sqes;
+    AppRingCQE* cqes;
+  };
+
+  Ring SetupRing() {
+    auto [ addr, err ] = SyscallRingSetup(kRingEntries, kRingEntries);
+    if (err) {
+      fprintf(stderr, "failed to set up ring: %d\n", err);
+      exit(1);
+    }
+    auto header = reinterpret_cast<AppRing*>(addr);
+    auto base = reinterpret_cast<uint8_t*>(addr);
+    return {header,
+            reinterpret_cast<AppRingSQE*>(base + header->sq_offset),
+            reinterpret_cast<AppRingCQE*>(base + header->cq_offset)};
+  }
+
+  void Submit(Ring& ring, const AppRingSQE& sqe) {
+    const uint32_t tail = ring.header->sq_tail;
+    ring.sqes[tail & (kRingEntries - 1)] = sqe;
+    __atomic_store_n(&ring.header->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  bool Reap(Ring& ring, AppRingCQE& cqe) {
+    const uint32_t head = ring.header->cq_head;
+    if (head == __atomic_load_n(&ring.header->cq_tail, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    cqe = ring.cqes[head & (kRingEntries - 1)];
+    __atomic_store_n(&ring.header->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  size_t ReadBySyscall(const char* path, char* buf, size_t chunk) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "failed to open %s\n", path);
+      exit(1);
+    }
+    size_t total = 0;
+    while (true) {
+      const ssize_t n = read(fd, buf, chunk);
+      if (n <= 0) {
+        break;
+      }
+      total += n;
+    }
+    close(fd);
+    return total;
+  }
+
+  size_t ReadByRing(Ring& ring, const char* path, char* buf, size_t chunk) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "failed to open %s\n", path);
+      exit(1);
+    }
+    // ファイル位置は投入順に進むので，同じバッファに続けて読ませてよい
+    size_t total = 0;
+    bool eof = false;
+    while (!eof) {
+      for (uint32_t i = 0; i < kRingEntries; ++i) {
+        Submit(ring, AppRingSQE{AppRingSQE::kRead, fd,
+                                reinterpret_cast<uint64_t>(buf), chunk, 0, i});
+      }
+      SyscallRingEnter(kRingEntries);
+      AppRingCQE cqe;
+      while (Reap(ring, cqe)) {
+        if (cqe.error || cqe.value == 0) {
+          eof = true;
+        }
+        total += cqe.value;
+      }
+    }
+    close(fd);
+    return total;
+  }
+}
+
+extern "C" void main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <file> [chunk bytes]\n", argv[0]);
+    exit(1);
+  }
+  size_t chunk = 512;
+  if (argc >= 3) {
+    chunk = atoi(argv[2]);
+  }
+  if (chunk == 0 || chunk > 65536) {
+    fprintf(stderr, "invalid chunk size: %lu\n", chunk);
+    exit(1);
+  }
+  static char buf[65536];
+
+  const uint64_t t0 = ReadTSC();
+  const size_t bytes_syscall = ReadBySyscall(argv[1], buf, chunk);
+  const uint64_t t1 = ReadTSC();
+
+  Ring ring = SetupRing();
+  const uint64_t t2 = ReadTSC();
+  const size_t bytes_ring = ReadByRing(ring, argv[1], buf, chunk);
+  const uint64_t t3 = ReadTSC();
+
+  printf("read:  %lu bytes, %lu cycles\n", bytes_syscall, t1 - t0);
+  printf("ring:  %lu bytes, %lu cycles (%u ops per doorbell)\n",
+         bytes_ring, t3 - t2, kRingEntries);
+
+  // タイマはタイマ割り込みの中で完了する
+  auto [ tick_start, timer_freq ] = SyscallGetCurrentTick();
+  Submit(ring, AppRingSQE{AppRingSQE::kTimer, 0, 0, 0, 100, 0});
+  SyscallRingEnter(1);
+  AppRingCQE cqe;
+  Reap(ring, cqe);
+  printf("timer: 100 ms requested, completed after %lu ms\n",
+         (SyscallGetCurrentTick().value - tick_start) * 1000 / timer_freq);
+  exit(0);
+}
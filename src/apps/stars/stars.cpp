@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <random>
+#include <vector>
 #include "../syscall.h"
 
 static constexpr int kWidth = 100, kHeight = 100;
@@ -21,15 +24,26 @@ extern "C" void main(int argc, char** argv) {
 
   auto [tick_start, timer_freq] = SyscallGetCurrentTick();
 
+  // 全ての星を描画コマンドとして溜め，なるべく少ない回数のシステムコールで描画する
+  std::vector<AppDrawCommand> cmds(num_stars);
   std::default_random_engine rand_engine;
   std::uniform_int_distribution x_dist(0, kWidth - 2), y_dist(0, kHeight - 2);
   for (int i = 0; i < num_stars; ++i) {
     int x = x_dist(rand_engine);
     int y = y_dist(rand_engine);
-    SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                            4 + x, 24 + y, 2, 2, 0xfff100);
+    cmds[i].type = AppDrawCommand::kFillRectangle;
+    cmds[i].color = 0xfff100;
+    cmds[i].arg.rect = {4 + x, 24 + y, 2, 2};
+  }
+  for (size_t i = 0; i < cmds.size(); i += kAppMaxDrawCommands) {
+    const size_t n = std::min<size_t>(cmds.size() - i, kAppMaxDrawCommands);
+    // 再描画は最後のまとまりを描いたときに 1 回だけ行う
+    const uint64_t flags = i + n < cmds.size() ? LAYER_NO_REDRAW : 0;
+    if (auto res = SyscallWinDrawCommands(layer_id | flags, &cmds[i], n); res.error) {
+      fprintf(stderr, "failed to draw stars: %d\n", res.error);
+      exit(res.error);
+    }
   }
-  SyscallWinRedraw(layer_id);
 
   auto tick_end = SyscallGetCurrentTick();
   printf("%d stars in %lu ms.\n",
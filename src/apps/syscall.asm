@@ -16,7 +16,6 @@ define_syscall Exit,             0x80000002
 define_syscall OpenWindow,       0x80000003
 define_syscall WinWriteString,   0x80000004
 define_syscall WinFillRectangle, 0x80000005
-define_syscall GetCurrentTick,   0x80000006
 define_syscall WinRedraw,        0x80000007
 define_syscall WinDrawLine,      0x80000008
 define_syscall CloseWindow,      0x80000009
@@ -26,3 +25,22 @@ define_syscall OpenFile,         0x8000000c
 define_syscall ReadFile,         0x8000000d
 define_syscall DemandPages,      0x8000000e
 define_syscall MapFile,          0x8000000f
+define_syscall WinDrawLines,     0x80000010
+define_syscall WinDrawPolyline,  0x80000011
+define_syscall WinFillPolygon,   0x80000012
+define_syscall OpenWindowSurface, 0x80000013
+define_syscall WinCommit,        0x80000014
+define_syscall WinDrawCommands,  0x80000015
+define_syscall Fsync,            0x80000016
+define_syscall Nop,              0x80000017
+define_syscall RingSetup,        0x80000018
+define_syscall RingEnter,        0x80000019
+define_syscall Poll,             0x8000001a
+define_syscall ThreadCreate,     0x8000001b
+define_syscall ThreadJoin,       0x8000001c
+define_syscall FutexWait,        0x8000001d
+define_syscall FutexWake,        0x8000001e
+define_syscall ThreadSelf,       0x8000001f
+define_syscall IsTerminal,       0x80000020
+define_syscall RemoveFile,       0x80000021
+define_syscall MakeDirectory,    0x80000022
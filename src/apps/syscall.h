@@ -10,6 +10,10 @@ extern "C" {
 
 #include "../kernel/logger.hpp"
 #include "../kernel/app_event.hpp"
+#include "../kernel/app_draw.hpp"
+#include "../kernel/app_sysinfo.hpp"
+#include "../kernel/app_ring.hpp"
+#include "../kernel/app_poll.hpp"
 
 struct SyscallResult {
   uint64_t value;
@@ -26,6 +30,7 @@ struct SyscallResult SyscallWinWriteString(
     uint64_t layer_id_flags, int x, int y, uint32_t color, const char* s);
 struct SyscallResult SyscallWinFillRectangle(
     uint64_t layer_id_flags, int x, int y, int w, int h, uint32_t color);
+// カーネルに入らず，共有ページ（AppSysInfo）から読み出す
 struct SyscallResult SyscallGetCurrentTick();
 struct SyscallResult SyscallWinRedraw(uint64_t layer_id_flags);
 struct SyscallResult SyscallWinDrawLine(
@@ -44,6 +49,60 @@ struct SyscallResult SyscallReadFile(int fd, void* buf, size_t count);
 struct SyscallResult SyscallDemandPages(size_t num_pages, int flags);
 struct SyscallResult SyscallMapFile(int fd, size_t* file_size, int flags);
 
+struct SyscallResult SyscallWinDrawLines(
+    uint64_t layer_id_flags, const struct AppLine* lines, size_t num_lines);
+struct SyscallResult SyscallWinDrawPolyline(
+    uint64_t layer_id_flags, const struct AppPoint* points, size_t num_points,
+    uint32_t color);
+struct SyscallResult SyscallWinFillPolygon(
+    uint64_t layer_id_flags, const struct AppPoint* points, size_t num_points,
+    uint32_t color);
+
+struct SyscallResult SyscallOpenWindowSurface(
+    int w, int h, int x, int y, const char* title,
+    struct AppWindowSurface* surface);
+struct SyscallResult SyscallWinCommit(
+    uint64_t layer_id_flags, int x, int y, int w, int h);
+struct SyscallResult SyscallWinDrawCommands(
+    uint64_t layer_id_flags, const struct AppDrawCommand* cmds, size_t num_cmds);
+struct SyscallResult SyscallFsync(int fd);
+/** @brief 何もしないシステムコール。入口と出口の所要時間の測定用。 */
+struct SyscallResult SyscallNop();
+
+/** @brief I/O リングを作り，マップしたアドレス（struct AppRing*）を返す。
+ * 要素数はどちらも 2 のべき乗。 */
+struct SyscallResult SyscallRingSetup(uint32_t sq_entries, uint32_t cq_entries);
+/** @brief 投入キューに積んだ操作を実行させ，完了が min_complete 個たまるまで待つ。
+ * 完了していない操作がなくなれば，min_complete に届かなくても戻る。
+ * 取り出された投入要素の数を返す。 */
+struct SyscallResult SyscallRingEnter(uint32_t min_complete);
+/** @brief fds のどれかが条件を満たすか，timeout_ms が経つまで待つ。
+ * timeout_ms が負なら無期限に待ち，0 なら待たない。条件を満たした要素の数を返す。 */
+struct SyscallResult SyscallPoll(struct AppPollFd* fds, size_t nfds, int timeout_ms);
+
+/** @brief 同じアプリの中にスレッドを作り，ID を返す。
+ * スレッドは entry(0, arg) として呼ばれ，SyscallExit で終了する。
+ * 通常は thread.h の ThreadCreate を使う。 */
+struct SyscallResult SyscallThreadCreate(
+    void (*entry)(int, void*), void* arg);
+/** @brief スレッドの終了を待ち，終了コードを返す。 */
+struct SyscallResult SyscallThreadJoin(uint64_t thread_id);
+/** @brief *addr が expected のままなら，SyscallFutexWake で起こされるまで眠る。
+ * timeout_ms が負なら無期限に待つ。値が違えば EAGAIN，時間切れなら ETIMEDOUT。 */
+struct SyscallResult SyscallFutexWait(
+    const uint32_t* addr, uint32_t expected, int timeout_ms);
+/** @brief addr で待っているスレッドを最大 num 個起こし，起こした数を返す。 */
+struct SyscallResult SyscallFutexWake(const uint32_t* addr, size_t num);
+/** @brief 呼び出したスレッドの ID を返す。 */
+struct SyscallResult SyscallThreadSelf();
+/** @brief fd が端末につながっていれば 1，そうでなければ 0 を返す。 */
+struct SyscallResult SyscallIsTerminal(int fd);
+/** @brief ファイルか空のディレクトリを削除する。
+ * 見つからなければ ENOENT，空でないディレクトリなら ENOTEMPTY。 */
+struct SyscallResult SyscallRemoveFile(const char* path);
+/** @brief 空のディレクトリを作る。既にあれば EEXIST。 */
+struct SyscallResult SyscallMakeDirectory(const char* path);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
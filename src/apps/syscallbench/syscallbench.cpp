@@ -0,0 +1,42 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "../syscall.h"
+
+// 何もしないシステムコールを繰り返し呼び，1 回あたりのサイクル数を測る
+// 引数: 呼び出し回数（省略時 100000）
+namespace {
+  inline uint64_t ReadTSC() {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return static_cast<uint64_t>(hi) << 32 | lo;
+  }
+}
+
+extern "C" void main(int argc, char** argv) {
+  int count = 100000;
+  if (argc >= 2) {
+    count = atoi(argv[1]);
+  }
+  if (count <= 0) {
+    fprintf(stderr, "invalid count: %d\n", count);
+    exit(1);
+  }
+
+  // タイマ割り込みやタスク切り替えが挟まった回を除くため，最小値も出す
+  uint64_t min_cycles = UINT64_MAX;
+  const uint64_t start = ReadTSC();
+  for (int i = 0; i < count; ++i) {
+    const uint64_t t0 = ReadTSC();
+    SyscallNop();
+    const uint64_t cycles = ReadTSC() - t0;
+    if (cycles < min_cycles) {
+      min_cycles = cycles;
+    }
+  }
+  const uint64_t total = ReadTSC() - start;
+
+  printf("%d null syscalls: avg %lu cycles, min %lu cycles\n",
+         count, total / count, min_cycles);
+  exit(0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifdef __cplusplus
+#include <cstdint>
+
+extern "C" {
+#else
+#include <stdint.h>
+#endif
+
+/** @brief futex で待つ排他ロック。0 で初期化する。
+ * state は 0: 空き，1: ロック中，2: ロック中で待っているスレッドがいるかもしれない */
+struct Mutex {
+  uint32_t state;
+};
+
+/** @brief 条件変数。0 で初期化する。 */
+struct Cond {
+  uint32_t seq;
+};
+
+/** @brief func(arg) を実行するスレッドを作り，ID を返す。失敗したら -1 を返す。
+ * スレッドはアプリのメモリとファイルを共有する。func から戻るとスレッドは終了する。 */
+int ThreadCreate(void (*func)(void*), void* arg);
+/** @brief スレッドの終了を待つ。成功したら 0 を返す。 */
+int ThreadJoin(int thread_id);
+
+void MutexLock(struct Mutex* m);
+void MutexUnlock(struct Mutex* m);
+
+/** @brief m を解放して c が通知されるまで待ち，m を取り直して戻る。 */
+void CondWait(struct Cond* c, struct Mutex* m);
+void CondSignal(struct Cond* c);
+void CondBroadcast(struct Cond* c);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,293 @@
+/**
+ * @file app_cache.cpp
+ *
+ * アプリのイメージのキャッシュを実装したファイル．
+ */
+
+#include "app_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "elf.hpp"
+#include "logger.hpp"
+
+namespace {
+  struct AppImageKey {
+    uint32_t cluster, size;
+    uint16_t write_date, write_time;
+    // 最終更新日時は 2 秒単位なので，その間の書き換えは世代番号で見分ける
+    uint32_t generation;
+
+    bool operator<(const AppImageKey& rhs) const {
+      return std::tie(cluster, size, write_date, write_time, generation) <
+        std::tie(rhs.cluster, rhs.size, rhs.write_date, rhs.write_time,
+                 rhs.generation);
+    }
+  };
+
+  struct CachedImage {
+    AppLoadInfo load;
+    char name[13];
+    unsigned long last_used; // 最後に取得されたときの use_counter
+  };
+
+  std::map<AppImageKey, CachedImage>* images;
+  /** @brief 先頭クラスタごとの書き込みの世代番号．書き込まれたことのないファイルは 0 */
+  std::map<uint32_t, uint32_t>* file_generations;
+  unsigned long use_counter;
+  AppCacheStats stats;
+
+  /** @brief 起動時に先読みしておくアプリ */
+  const char* const kPrewarmApps[] = {
+    "/apps/runtime", "/apps/grep", "/apps/sort", "/apps/more", "/apps/cp",
+  };
+
+  /** @brief ELF ヘッダとプログラムヘッダだけを読み，要求時に読み込むイメージを作る．
+   *
+   * セグメントの中身はここでは読まず，触れられたページだけを
+   * ページフォールト時に読み込む．
+   */
+  WithError<AppLoadInfo> LoadELF(fat::DirectoryEntry& file_entry) {
+    auto file = std::make_shared<fat::FileDescriptor>(file_entry);
+
+    Elf64_Ehdr ehdr;
+    if (file->Load(&ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+        memcmp(ehdr.e_ident, "\x7f" "ELF", 4) != 0) {
+      return {{}, MAKE_ERROR(Error::kInvalidFile)};
+    }
+    if (ehdr.e_type != ET_EXEC || ehdr.e_phentsize != sizeof(Elf64_Phdr)) {
+      return {{}, MAKE_ERROR(Error::kInvalidFormat)};
+    }
+
+    std::vector<Elf64_Phdr> phdrs(ehdr.e_phnum);
+    const size_t phdrs_bytes = phdrs.size() * sizeof(Elf64_Phdr);
+    if (file->Load(phdrs.data(), phdrs_bytes, ehdr.e_phoff) != phdrs_bytes) {
+      return {{}, MAKE_ERROR(Error::kInvalidFile)};
+    }
+
+    std::vector<LoadSegment> segments;
+    uint64_t last_addr = 0;
+    for (const auto& phdr : phdrs) {
+      if (phdr.p_type != PT_LOAD) continue;
+      if (phdr.p_vaddr < 0xffff'8000'0000'0000 || phdr.p_filesz > phdr.p_memsz) {
+        return {{}, MAKE_ERROR(Error::kInvalidFormat)};
+      }
+      segments.push_back({phdr.p_vaddr, phdr.p_memsz, phdr.p_offset, phdr.p_filesz});
+      last_addr = std::max(last_addr, phdr.p_vaddr + phdr.p_memsz);
+    }
+
+    auto [pml4, err] = NewPageMap();
+    if (err) {
+      return {{}, err};
+    }
+    auto image = new AppImage{file, std::move(segments), pml4};
+    return {AppLoadInfo{last_addr, ehdr.e_entry, pml4, image},
+            MAKE_ERROR(Error::kSuccess)};
+  }
+
+  void FreeImage(AppImage* image) {
+    if (auto err = FreePageMapTree(image->pml4, 4)) {
+      Log(kWarn, "failed to free app image: %s\n", err.Name());
+    }
+    delete image;
+  }
+
+  /** @brief 使われていないイメージを古い順に解放し，ページ数を上限に収める．
+   *
+   * 割り込みを禁止した状態で呼ぶ．
+   */
+  void EvictImages() {
+    size_t resident_pages = 0;
+    for (const auto& [key, cached] : *images) {
+      resident_pages += cached.load.image->num_pages;
+    }
+
+    while (resident_pages > kAppCacheBudgetPages) {
+      auto victim = images->end();
+      for (auto it = images->begin(); it != images->end(); ++it) {
+        if (it->second.load.image->num_users == 0 &&
+            (victim == images->end() || it->second.last_used < victim->second.last_used)) {
+          victim = it;
+        }
+      }
+      if (victim == images->end()) {
+        break;
+      }
+
+      auto image = victim->second.load.image;
+      resident_pages -= image->num_pages;
+      images->erase(victim);
+      FreeImage(image);
+      ++stats.evictions;
+    }
+  }
+
+  /** @brief key と同じファイルの書き換え前のイメージのうち，使われていないものを解放する．
+   *
+   * key のイメージ自身は使用中にしてから呼ぶ．割り込みを禁止した状態で呼ぶ．
+   */
+  void DropStaleImages(const AppImageKey& key) {
+    for (auto it = images->begin(); it != images->end(); ) {
+      auto image = it->second.load.image;
+      if (it->first.cluster != key.cluster || image->num_users > 0) {
+        ++it;
+        continue;
+      }
+      it = images->erase(it);
+      FreeImage(image);
+      ++stats.evictions;
+    }
+  }
+
+  /** @brief cluster のファイルの現在の世代番号．割り込みを禁止した状態で呼ぶ． */
+  uint32_t FileGeneration(uint32_t cluster) {
+    auto it = file_generations->find(cluster);
+    return it == file_generations->end() ? 0 : it->second;
+  }
+
+  void TaskPrewarmApps(uint64_t task_id, int64_t data) {
+    for (auto path : kPrewarmApps) {
+      auto [file_entry, post_slash] = fat::FindFile(path);
+      if (file_entry == nullptr || post_slash) {
+        continue;
+      }
+      auto [app_load, err] = AcquireAppImage(*file_entry);
+      if (err) {
+        Log(kWarn, "failed to prewarm %s: %s\n", path, err.Name());
+        continue;
+      }
+      if (auto err = PrefetchAppImage(*app_load.image)) {
+        Log(kWarn, "failed to prewarm %s: %s\n", path, err.Name());
+      }
+      ReleaseAppImage(app_load.image);
+    }
+
+    __asm__("cli");
+    task_manager->Finish(0);
+  }
+}
+
+void InitializeAppCache() {
+  images = new std::map<AppImageKey, CachedImage>;
+  file_generations = new std::map<uint32_t, uint32_t>;
+  task_manager->NewTask()
+    .InitContext(TaskPrewarmApps, 0)
+    .Wakeup();
+}
+
+WithError<AppLoadInfo> AcquireAppImage(fat::DirectoryEntry& file_entry) {
+  AppImageKey key{file_entry.FirstCluster(), file_entry.file_size,
+                  file_entry.write_date, file_entry.write_time, 0};
+
+  __asm__("cli");
+  key.generation = FileGeneration(key.cluster);
+  if (auto it = images->find(key); it != images->end()) {
+    it->second.last_used = ++use_counter;
+    ++it->second.load.image->num_users;
+    ++stats.hits;
+    const auto app_load = it->second.load;
+    __asm__("sti");
+    return {app_load, MAKE_ERROR(Error::kSuccess)};
+  }
+  __asm__("sti");
+
+  auto [app_load, err] = LoadELF(file_entry);
+  if (err) {
+    return {{}, err};
+  }
+
+  CachedImage cached{app_load, {}, 0};
+  fat::FormatName(file_entry, cached.name);
+
+  __asm__("cli");
+  auto [it, inserted] = images->insert(std::make_pair(key, cached));
+  it->second.last_used = ++use_counter;
+  ++it->second.load.image->num_users;
+  if (inserted) {
+    ++stats.misses;
+    DropStaleImages(key);
+  } else {
+    // 読み込んでいる間に他のタスクが同じイメージを登録した
+    FreeImage(app_load.image);
+    ++stats.hits;
+  }
+  const auto result = it->second.load;
+  EvictImages();
+  __asm__("sti");
+  return {result, MAKE_ERROR(Error::kSuccess)};
+}
+
+void ReleaseAppImage(AppImage* image) {
+  __asm__("cli");
+  --image->num_users;
+  EvictImages();
+  __asm__("sti");
+}
+
+Error PrepareAppFileWrite(uint32_t cluster) {
+  if (images == nullptr || cluster == 0) {
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
+  std::vector<AppImage*> in_use;
+  __asm__("cli");
+  ++(*file_generations)[cluster];
+  for (const auto& [key, cached] : *images) {
+    auto image = cached.load.image;
+    if (key.cluster == cluster && image->num_users > 0) {
+      // 読み込んでいる間に解放されないよう，使用中にしておく
+      ++image->num_users;
+      in_use.push_back(image);
+    }
+  }
+  __asm__("sti");
+
+  auto result = MAKE_ERROR(Error::kSuccess);
+  for (auto image : in_use) {
+    if (auto err = PrefetchAppImage(*image); err && !result) {
+      result = err;
+    }
+    ReleaseAppImage(image);
+  }
+  return result;
+}
+
+AppCacheStats GetAppCacheStats() {
+  __asm__("cli");
+  AppCacheStats s = stats;
+  s.num_images = images->size();
+  s.resident_pages = 0;
+  for (const auto& [key, cached] : *images) {
+    s.resident_pages += cached.load.image->num_pages;
+  }
+  __asm__("sti");
+  return s;
+}
+
+void ForEachAppImage(
+    const std::function<void (const char* name, size_t num_pages, int num_users)>& f) {
+  struct Entry {
+    char name[13];
+    size_t num_pages;
+    int num_users;
+  };
+
+  // 出力中にキャッシュが変わっても困らないよう，先に写し取る
+  std::vector<Entry> entries;
+  __asm__("cli");
+  for (const auto& [key, cached] : *images) {
+    Entry e{{}, cached.load.image->num_pages, cached.load.image->num_users};
+    memcpy(e.name, cached.name, sizeof(e.name));
+    entries.push_back(e);
+  }
+  __asm__("sti");
+
+  for (const auto& e : entries) {
+    f(e.name, e.num_pages, e.num_users);
+  }
+}
@@ -0,0 +1,65 @@
+/**
+ * @file app_cache.hpp
+ *
+ * 読み込んだアプリのイメージを保持するキャッシュ．
+ *
+ * イメージはファイルの先頭クラスタ，サイズ，最終更新日時と，
+ * ファイルへの書き込みのたびに進める世代番号の組で識別するので，
+ * 書き換えられたファイルは別のイメージとして読み込み直される．
+ * 読み込んだページの合計が kAppCacheBudgetPages を超えると，
+ * 実行中のタスクが使っていないイメージを最後に使われたのが古い順に解放する．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "error.hpp"
+#include "fat.hpp"
+#include "paging.hpp"
+#include "task.hpp"
+
+struct AppLoadInfo {
+  uint64_t vaddr_end, entry;
+  PageMapEntry* pml4;
+  AppImage* image;
+};
+
+/** @brief キャッシュが保持するページ数の目安（16MiB） */
+const size_t kAppCacheBudgetPages = 4096;
+
+struct AppCacheStats {
+  unsigned long hits, misses, evictions;
+  size_t num_images, resident_pages;
+};
+
+/** @brief キャッシュを初期化し，よく使うアプリを先読みするタスクを起動する． */
+void InitializeAppCache();
+
+/** @brief ファイルのイメージをキャッシュから取得する．無ければ ELF ヘッダを読んで登録する．
+ *
+ * 取得したイメージは ReleaseAppImage を呼ぶまで解放されない．
+ * 返す AppLoadInfo の pml4 はイメージのページテーブル．
+ */
+WithError<AppLoadInfo> AcquireAppImage(fat::DirectoryEntry& file_entry);
+
+/** @brief AcquireAppImage で取得したイメージを手放す． */
+void ReleaseAppImage(AppImage* image);
+
+/** @brief 先頭クラスタが cluster のファイルへ書き込む前，または削除する前に呼ぶ．
+ *
+ * イメージはページを要求時にファイルから読むので，実行中のタスクが使っているイメージは
+ * 残りのページをここで読み込んでおき，書き換え後の内容が混ざらないようにする．
+ * 以降の AcquireAppImage は書き換え後のファイルを別のイメージとして読み込む．
+ *
+ * @return 読み込めなかったらエラー．このときは書き込みを中止すること．
+ */
+Error PrepareAppFileWrite(uint32_t cluster);
+
+AppCacheStats GetAppCacheStats();
+
+/** @brief キャッシュ中のイメージの名前，読み込み済みページ数，使用中のタスク数を f へ渡す． */
+void ForEachAppImage(
+    const std::function<void (const char* name, size_t num_pages, int num_users)>& f);
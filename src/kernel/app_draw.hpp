@@ -0,0 +1,71 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief 描画系システムコールにまとめて渡す頂点． */
+struct AppPoint {
+  int x, y;
+};
+
+/** @brief SyscallWinDrawLines にまとめて渡す 1 本分の線分． */
+struct AppLine {
+  int x0, y0;
+  int x1, y1;
+  uint32_t color;
+};
+
+/** @brief SyscallWinDrawCommands にまとめて渡す描画コマンド．
+ *
+ * 座標はすべてウィンドウの左上を基準とする．
+ */
+struct AppDrawCommand {
+  enum Type {
+    kFillRectangle,
+    kDrawLine,
+    kWriteString,
+    kBlit, // 0x00RRGGBB 形式の画素を w x h 個，行の隙間なく並べた配列を転送する
+  } type;
+  uint32_t color; // kBlit では使わない
+
+  union {
+    struct {
+      int x, y;
+      int w, h;
+    } rect;
+
+    struct {
+      int x0, y0;
+      int x1, y1;
+    } line;
+
+    struct {
+      int x, y;
+      const char* s;
+    } text;
+
+    struct {
+      int x, y;
+      int w, h;
+      const uint32_t* pixels;
+    } blit;
+  } arg;
+};
+
+/** @brief 1 回の SyscallWinDrawCommands で受け付ける描画コマンドの最大数．超えると E2BIG */
+static const unsigned long kAppMaxDrawCommands = 65536;
+
+/** @brief SyscallOpenWindowSurface で得られるウィンドウ描画面の情報．
+ *
+ * pixels は 0x00RRGGBB 形式の画素が width x height 個，行の隙間なく並ぶ．
+ * 書き込んだ内容は SyscallWinCommit で反映するまで画面には現れない．
+ */
+struct AppWindowSurface {
+  uint32_t* pixels;
+  int width, height;
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Poll システムコールで待つ対象の 1 つ．
+ *
+ * fd が 0 以上ならファイルディスクリプタ．負の値は次の特別な対象を表す．
+ *   kAppPollEvents: ReadEvent で受け取れるイベント（キー，マウス，タイマ，ウィンドウ）
+ *   kAppPollRing:   I/O リングの完了キューに取り出していない要素がある
+ */
+struct AppPollFd {
+  int fd;
+  short events;   // 待つ条件．kAppPollIn と kAppPollOut の組み合わせ
+  short revents;  // 満たされた条件．カーネルが書く
+};
+
+static const int kAppPollEvents = -2;
+static const int kAppPollRing = -3;
+
+// 値は POSIX の POLLIN, POLLOUT, POLLNVAL に合わせてある
+static const short kAppPollIn = 0x0001;
+static const short kAppPollOut = 0x0004;
+static const short kAppPollNval = 0x0020;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
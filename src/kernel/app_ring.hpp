@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief 投入キューの要素．アプリが書き，カーネルが読む． */
+struct AppRingSQE {
+  enum Opcode {
+    kNop,
+    kOpen,   // addr: パス，arg: フラグ．value に fd が返る
+    kRead,   // fd から addr に len バイト読む
+    kWrite,  // addr から fd に len バイト書く
+    kDraw,   // arg: レイヤ ID とフラグ，addr: AppDrawCommand の配列，len: 要素数
+    kTimer,  // arg: 何ミリ秒後に完了させるか．value に期限の tick が返る
+  } opcode;
+  int fd;
+  uint64_t addr;
+  uint64_t len;
+  uint64_t arg;
+  uint64_t user_data; // 完了キューの要素にそのまま返される
+};
+
+/** @brief 完了キューの要素．カーネルが書き，アプリが読む． */
+struct AppRingCQE {
+  uint64_t user_data;
+  uint64_t value;
+  int error;
+};
+
+/** @brief アプリのアドレス空間にマップされる I/O リングの先頭．
+ *
+ * 投入キューはアプリが sq_tail を進めて要素を追加し，カーネルが sq_head を進めて取り出す．
+ * 完了キューはカーネルが cq_tail を進めて要素を追加し，アプリが cq_head を進めて取り出す．
+ * 添字はそれぞれの要素数で割った余りを使う．要素数は 2 のべき乗．
+ */
+struct AppRing {
+  uint32_t sq_head, sq_tail;
+  uint32_t cq_head, cq_tail;
+  uint32_t sq_entries, cq_entries;
+  uint32_t sq_offset, cq_offset; // AppRing の先頭から各キューの配列までのバイト数
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
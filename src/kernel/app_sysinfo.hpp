@@ -0,0 +1,26 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief 全アプリの空間に読み出し専用でマップされる，カーネルが更新するページ．
+ *
+ * 値の読み出しにシステムコールを使わずに済ませるためのもの．
+ * tick はタイマ割り込みごとに更新される．それ以外は起動時に決まる．
+ */
+struct AppSysInfo {
+  uint64_t tick;              // タイマ割り込みの回数
+  uint64_t timer_freq;        // tick の周波数（Hz）
+  uint64_t tsc_base;          // 計時の基準とした TSC の値
+  uint64_t tsc_freq;          // TSC の周波数（Hz）．0 なら TSC で計時できない
+  uint64_t realtime_base;     // tsc_base の時点の UNIX 時間（秒）
+  int32_t screen_width, screen_height;
+};
+
+/** @brief AppSysInfo をマップするアドレス */
+static const uint64_t kAppSysInfoAddr = 0xffff900000000000;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -19,6 +19,34 @@ IoIn32:
     in eax, dx
     ret
 
+global IoOut16  ; void IoOut16(uint16_t addr, uint16_t data);
+IoOut16:
+    mov dx, di    ; dx = addr
+    mov ax, si    ; ax = data
+    out dx, ax
+    ret
+
+global IoIn16  ; uint16_t IoIn16(uint16_t addr);
+IoIn16:
+    mov dx, di    ; dx = addr
+    xor eax, eax
+    in ax, dx
+    ret
+
+global IoOut8  ; void IoOut8(uint16_t addr, uint8_t data);
+IoOut8:
+    mov dx, di    ; dx = addr
+    mov al, sil   ; al = data
+    out dx, al
+    ret
+
+global IoIn8  ; uint8_t IoIn8(uint16_t addr);
+IoIn8:
+    mov dx, di    ; dx = addr
+    xor eax, eax
+    in al, dx
+    ret
+
 global GetCS  ; uint16_t GetCS(void);
 GetCS:
     xor eax, eax  ; also clears upper 32 bits of rax
@@ -285,52 +313,70 @@ WriteMSR:  ; void WriteMSR(uint32_t msr, uint64_t value);
     wrmsr
     ret
 
-extern GetCurrentTaskOSStackPointer
+; struct PerCPUData のメンバのオフセット（per_cpu.hpp と合わせる）
+%define PER_CPU_OS_STACK_PTR 0x08
+%define PER_CPU_USER_RSP     0x10
+
 extern syscall_table
+extern PendingKillStackPointer
 global SyscallEntry
 SyscallEntry:  ; void SyscallEntry(void);
-    push rbp
+    ; IA32_FMASK で IF を下ろしてあるので，OS 用スタックへ移るまで割り込まれない
+    swapgs
+    mov [gs:PER_CPU_USER_RSP], rsp
+    mov rsp, [gs:PER_CPU_OS_STACK_PTR]
+    mov rsp, [rsp]  ; 実行中のタスクの OS 用スタック
+    push qword [gs:PER_CPU_USER_RSP]
+    swapgs
+    sti
+
     push rcx  ; original RIP
     push r11  ; original RFLAGS
-
     push rax  ; システムコール番号を保存
-
-    mov rcx, r10
-    and eax, 0x7fffffff
+    push rbp
     mov rbp, rsp
-
-    ; システムコールを OS 用スタックで実行するための準備
-    and rsp, 0xfffffffffffffff0
-    push rax
-    push rdx
-    cli
-    call GetCurrentTaskOSStackPointer
-    sti
-    mov rdx, [rsp + 0]  ; RDX
-    mov [rax - 16], rdx
-    mov rdx, [rsp + 8]  ; RAX
-    mov [rax - 8], rdx
-
-    lea rsp, [rax - 16]
-    pop rdx
-    pop rax
     and rsp, 0xfffffffffffffff0
 
+    mov rcx, r10
+    and eax, 0x7fffffff
     call [syscall_table + 8 * eax]
     ; rbx, r12-r15 は callee-saved なので呼び出し側で保存しない
     ; rax は戻り値用なので呼び出し側で保存しない
 
     mov rsp, rbp
-
+    pop rbp
     pop rsi  ; システムコール番号を復帰
     cmp esi, 0x80000002
     je  .exit
 
+    ; アプリのスタックに戻ってから sysret するまでに割り込まれないようにする
+    cli
+
+    ; 終了を求められたスレッドはアプリへ戻らずに終了する
+    push rbp
+    mov rbp, rsp
+    and rsp, 0xfffffffffffffff0
+    push rax  ; 戻り値を保存
+    push rdx
+    call PendingKillStackPointer
+    mov rdi, rax
+    pop rdx
+    pop rax
+    mov rsp, rbp
+    pop rbp
+    test rdi, rdi
+    jnz .killed
+
     pop r11
     pop rcx
-    pop rbp
+    pop rsp
     o64 sysret
 
+.killed:
+    sti
+    mov esi, -1
+    jmp ExitApp
+
 .exit:
     mov rdi, rax
     mov esi, edx
@@ -0,0 +1,291 @@
+/**
+ * @file block_cache.cpp
+ *
+ * ブロックデバイスのバッファキャッシュを実装したファイル．
+ */
+
+#include "block_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+#include "asmfunc.h"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+#include "paging.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+  const size_t kPageSize = 4096;
+  const size_t kSectorsPerPage = kPageSize / BlockDevice::kSectorSize;
+  /** @brief 1 回のフォルトで先読みする最大ページ数 */
+  const size_t kReadAheadPages = 16;
+
+  /** @brief 1 回の書き込み要求にまとめる最大ページ数 */
+  const size_t kFlushBatchPages = 256;
+  const int kFlushTimer = 1;
+  const unsigned long kFlushInterval = kTimerFreq * 5;
+  const int kFlusherTaskLevel = 1;
+
+  /** @brief 読み込んだままにしておくページ数の上限（64MiB） */
+  const size_t kMaxResidentPages = 16384;
+  /** @brief 1 回の追い出しで空けるページ数 */
+  const size_t kEvictBatchPages = 64;
+
+  BlockDevice* cache_device;
+  uint64_t cache_bytes;
+
+  bool flush_busy = false;
+  std::deque<Task*>* flush_waiters;  // flush_busy が落ちるのを待っているタスク
+  uint8_t* flush_buffer;  // kFlushBatchPages ページ分の連続したフレーム
+
+  size_t num_resident_pages = 0;
+  uint64_t evict_hand = kBlockCacheBase;  // 次に追い出し候補として調べるアドレス
+
+  bool PageMapped(uint64_t addr) {
+    auto entry = FindKernelPage(LinearAddress4Level{addr});
+    return entry && entry->bits.present;
+  }
+
+  /** @brief 書き換えられていないページを最大 n ページ追い出し，追い出した数を返す．
+   *
+   * 最近触れたページは accessed を落として 1 周だけ見逃す（クロック法）．
+   * 割り込み禁止で呼ぶこと．
+   */
+  size_t EvictCleanPages(size_t n) {
+    // フラッシュは dirty を落としてからデバイスへ書くので，その間のページは
+    // きれいに見えてもデバイスの内容が古い．追い出すと古い内容を読み直してしまう
+    if (flush_busy) {
+      return 0;
+    }
+
+    const uint64_t cache_end = kBlockCacheBase + cache_bytes;
+    size_t num_evicted = 0;
+    auto visit = [&](uint64_t addr, PageMapEntry& entry) {
+      if (num_evicted == n || entry.bits.dirty) {
+        return;
+      }
+      if (entry.bits.accessed) {
+        entry.bits.accessed = 0;
+        return;
+      }
+      const auto frame = reinterpret_cast<uintptr_t>(entry.Pointer());
+      entry.data = 0;
+      InvalidateTLB(addr);
+      memory_manager->Free(FrameID{frame / kBytesPerFrame}, 1);
+      --num_resident_pages;
+      ++num_evicted;
+      evict_hand = addr + kPageSize;
+    };
+
+    for (int round = 0; round < 2 && num_evicted < n; ++round) {
+      const uint64_t hand = evict_hand;
+      ForEachKernelPage(hand, cache_end, visit);
+      ForEachKernelPage(kBlockCacheBase, hand, visit);
+    }
+    if (evict_hand >= cache_end) {
+      evict_hand = kBlockCacheBase;
+    }
+    return num_evicted;
+  }
+}
+
+Error InitializeBlockCache(BlockDevice& dev) {
+  cache_device = &dev;
+  cache_bytes = std::min(dev.NumSectors() * BlockDevice::kSectorSize,
+                         kBlockCacheMaxBytes);
+  // BPB を含む先頭ページを読み込み，共有される PML4 エントリをここで作っておく
+  return HandleBlockCacheFault(kBlockCacheBase);
+}
+
+void* BlockCacheBase() {
+  return reinterpret_cast<void*>(kBlockCacheBase);
+}
+
+Error HandleBlockCacheFault(uint64_t causal_addr) {
+  const uint64_t page_addr = causal_addr & ~(kPageSize - 1);
+  const uint64_t offset = page_addr - kBlockCacheBase;
+  if (cache_device == nullptr || offset >= cache_bytes) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+
+  size_t num_pages = 1;
+  while (num_pages < kReadAheadPages &&
+         offset + num_pages * kPageSize < cache_bytes &&
+         !PageMapped(page_addr + num_pages * kPageSize)) {
+    ++num_pages;
+  }
+
+  if (num_resident_pages + num_pages > kMaxResidentPages) {
+    EvictCleanPages(std::max(kEvictBatchPages, num_pages));
+  }
+  auto frames = memory_manager->Allocate(num_pages);
+  if (frames.error) {
+    num_pages = 1;
+    frames = memory_manager->Allocate(1);
+  }
+  if (frames.error && EvictCleanPages(kEvictBatchPages) > 0) {
+    frames = memory_manager->Allocate(1);
+  }
+  if (frames.error) {
+    return frames.error;
+  }
+  auto buf = reinterpret_cast<uint8_t*>(frames.value.Frame());
+
+  // ボリュームの末尾がページ境界でなければ，はみ出た部分は 0 で埋める
+  const uint64_t lba = offset / BlockDevice::kSectorSize;
+  const size_t num_sectors = std::min<uint64_t>(
+      num_pages * kSectorsPerPage,
+      cache_device->NumSectors() - lba);
+  memset(buf + num_sectors * BlockDevice::kSectorSize, 0,
+         num_pages * kPageSize - num_sectors * BlockDevice::kSectorSize);
+  if (auto err = cache_device->Read(lba, buf, num_sectors)) {
+    memory_manager->Free(frames.value, num_pages);
+    return err;
+  }
+
+  for (size_t i = 0; i < num_pages; ++i) {
+    if (auto err = MapKernelPage(LinearAddress4Level{page_addr + i * kPageSize},
+                                 reinterpret_cast<uintptr_t>(buf + i * kPageSize))) {
+      return err;
+    }
+    ++num_resident_pages;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+namespace {
+  /** @brief flush_buffer に集めた run_pages ページを run_addr の位置へ書き込む． */
+  Error WriteRun(uint64_t run_addr, size_t run_pages) {
+    const uint64_t lba = (run_addr - kBlockCacheBase) / BlockDevice::kSectorSize;
+    const size_t num_sectors = std::min<uint64_t>(
+        run_pages * kSectorsPerPage, cache_device->NumSectors() - lba);
+    return cache_device->Write(lba, flush_buffer, num_sectors);
+  }
+
+  Error FlushDirtyPages(BlockCacheFlushStats& stats) {
+    if (flush_buffer == nullptr) {
+      auto frames = memory_manager->Allocate(kFlushBatchPages);
+      if (frames.error) {
+        return frames.error;
+      }
+      flush_buffer = reinterpret_cast<uint8_t*>(frames.value.Frame());
+    }
+
+    Error err = MAKE_ERROR(Error::kSuccess);
+    uint64_t run_addr = 0;
+    size_t run_pages = 0;
+    auto write_run = [&]() {
+      if (run_pages > 0 && !err) {
+        err = WriteRun(run_addr, run_pages);
+        ++stats.num_requests;
+      }
+      run_pages = 0;
+    };
+
+    ForEachKernelPage(
+        kBlockCacheBase, kBlockCacheBase + cache_bytes,
+        [&](uint64_t addr, PageMapEntry& entry) {
+          if (!entry.bits.dirty) {
+            return;
+          }
+          if (run_pages == kFlushBatchPages ||
+              (run_pages > 0 && addr != run_addr + run_pages * kPageSize)) {
+            write_run();
+          }
+          if (run_pages == 0) {
+            run_addr = addr;
+          }
+
+          // 先に dirty を落とすので，コピー中の書き込みは次回のフラッシュで拾われる
+          entry.bits.dirty = 0;
+          InvalidateTLB(addr);
+          memcpy(flush_buffer + run_pages * kPageSize,
+                 reinterpret_cast<const void*>(addr), kPageSize);
+          ++run_pages;
+          ++stats.num_pages;
+        });
+    write_run();
+    return err;
+  }
+
+  void TaskBlockCacheFlusher(uint64_t task_id, int64_t data) {
+    __asm__("cli");
+    Task& task = task_manager->CurrentTask();
+    timer_manager->AddTimer(
+        Timer{timer_manager->CurrentTick() + kFlushInterval, kFlushTimer, task_id});
+    __asm__("sti");
+
+    while (true) {
+      __asm__("cli");
+      auto msg = task.ReceiveMessage();
+      if (!msg) {
+        task.Sleep();
+        __asm__("sti");
+        continue;
+      }
+      __asm__("sti");
+
+      if (msg->type == Message::kTimerTimeout &&
+          msg->arg.timer.value == kFlushTimer) {
+        if (auto [ stats, err ] = FlushBlockCache(); err) {
+          Log(kError, "failed to flush block cache: %s\n", err.Name());
+        }
+        __asm__("cli");
+        timer_manager->AddTimer(
+            Timer{msg->arg.timer.timeout + kFlushInterval, kFlushTimer, task_id});
+        __asm__("sti");
+      }
+    }
+  }
+}
+
+WithError<BlockCacheFlushStats> FlushBlockCache() {
+  BlockCacheFlushStats stats{0, 0};
+  if (cache_device == nullptr) {
+    return {stats, MAKE_ERROR(Error::kSuccess)};
+  }
+
+  // 他のタスクが書き出し中のページは，そのフラッシュが終わるまでデバイスに届かない．
+  // 終わるまで眠って待つ
+  __asm__("cli");
+  Task& task = task_manager->CurrentTask();
+  while (flush_busy) {
+    if (flush_waiters == nullptr) {
+      flush_waiters = new std::deque<Task*>;
+    }
+    if (std::find(flush_waiters->begin(), flush_waiters->end(), &task) ==
+        flush_waiters->end()) {
+      flush_waiters->push_back(&task);
+    }
+    task.Sleep();
+    __asm__("cli");
+  }
+  flush_busy = true;
+  __asm__("sti");
+
+  auto err = FlushDirtyPages(stats);
+
+  __asm__("cli");
+  flush_busy = false;
+  if (flush_waiters) {
+    for (auto waiter : *flush_waiters) {
+      waiter->Wakeup();
+    }
+    flush_waiters->clear();
+  }
+  __asm__("sti");
+  return {stats, err};
+}
+
+void InitializeBlockCacheFlusher() {
+  if (cache_device == nullptr) {
+    return;
+  }
+  auto& task = task_manager->NewTask().InitContext(TaskBlockCacheFlusher, 0);
+  __asm__("cli");
+  task_manager->Wakeup(&task, kFlusherTaskLevel);
+  __asm__("sti");
+}
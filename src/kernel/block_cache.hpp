@@ -0,0 +1,61 @@
+/**
+ * @file block_cache.hpp
+ *
+ * ブロックデバイスの内容を仮想アドレス空間に写すバッファキャッシュ．
+ *
+ * ボリューム全体を kBlockCacheBase から始まる仮想アドレス範囲に対応付け，
+ * 初めて触れたページだけをページフォルトを契機にデバイスから読み込む．
+ * 読み込んだページが上限（64MiB）を超えると，書き換えられていないページから追い出す．
+ * 追い出したページも次に触れたときに同じアドレスへ読み直すので，ページへのポインタは保持し続けてよい．
+ *
+ * 書き込まれたページはページテーブルエントリの dirty ビットで検出し，
+ * フラッシュ時にアドレス順に並べて，連続したページを 1 つの要求にまとめて書き戻す．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "block_device.hpp"
+#include "error.hpp"
+
+/** @brief バッファキャッシュの先頭仮想アドレス（PML4 の 2 番目のエントリ．512GiB まで） */
+const uint64_t kBlockCacheBase = 0x0000'0100'0000'0000;
+const uint64_t kBlockCacheMaxBytes = 0x0000'0080'0000'0000;
+
+/** @brief dev をバッファキャッシュに対応付ける．
+ *
+ * アプリ用のページテーブルを作る前（全タスクで共有される PML4 エントリを作る前）に呼ぶこと．
+ */
+Error InitializeBlockCache(BlockDevice& dev);
+
+/** @brief バッファキャッシュに写したボリュームの先頭アドレスを返す． */
+void* BlockCacheBase();
+
+/** @brief addr がバッファキャッシュの範囲内なら true． */
+inline bool InBlockCache(uint64_t addr) {
+  return kBlockCacheBase <= addr && addr < kBlockCacheBase + kBlockCacheMaxBytes;
+}
+
+/** @brief バッファキャッシュ内で起きたページフォルトを処理する．
+ *
+ * フォルトしたページから最大 kReadAheadPages ページをまとめて読み込み，マップする．
+ * フレームが足りなければ書き換えられていないページを追い出して空ける．
+ */
+Error HandleBlockCacheFault(uint64_t causal_addr);
+
+struct BlockCacheFlushStats {
+  size_t num_pages;     // 書き戻したページ数
+  size_t num_requests;  // デバイスへ発行した書き込み要求の数
+};
+
+/** @brief 書き換えられたページをすべてデバイスへ書き戻す．
+ *
+ * 他のタスクがフラッシュ中なら，それが終わってから改めて全体をフラッシュする．
+ * したがって戻った時点で，呼び出し前に書き換えたページはすべてデバイスに届いている．
+ * バッファキャッシュを使っていない（RamBlockDevice の）場合は何もしない．
+ */
+WithError<BlockCacheFlushStats> FlushBlockCache();
+
+/** @brief 定期的に FlushBlockCache を呼ぶタスクを起動する．InitializeTask の後に呼ぶこと． */
+void InitializeBlockCacheFlusher();
@@ -0,0 +1,25 @@
+#include "block_device.hpp"
+
+#include <cstring>
+
+BlockDevice* boot_block_device;
+
+RamBlockDevice::RamBlockDevice(void* image, uint64_t num_sectors)
+    : image_{reinterpret_cast<uint8_t*>(image)}, num_sectors_{num_sectors} {
+}
+
+Error RamBlockDevice::Read(uint64_t lba, void* buf, size_t num_sectors) {
+  if (lba + num_sectors > num_sectors_) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  memcpy(buf, &image_[lba * kSectorSize], num_sectors * kSectorSize);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error RamBlockDevice::Write(uint64_t lba, const void* buf, size_t num_sectors) {
+  if (lba + num_sectors > num_sectors_) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  memmove(&image_[lba * kSectorSize], buf, num_sectors * kSectorSize);
+  return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file block_device.hpp
+ *
+ * セクタ単位で読み書きするブロックデバイスの抽象．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
+
+class BlockDevice {
+ public:
+  static const size_t kSectorSize = 512;
+
+  virtual ~BlockDevice() = default;
+
+  /** @brief lba から num_sectors 個のセクタを buf へ読み込む．
+   *
+   * buf は物理アドレスと仮想アドレスが一致する（アイデンティティマップされた）領域であること．
+   */
+  virtual Error Read(uint64_t lba, void* buf, size_t num_sectors) = 0;
+  /** @brief buf の内容を lba から num_sectors 個のセクタへ書き込む．buf の制約は Read と同じ． */
+  virtual Error Write(uint64_t lba, const void* buf, size_t num_sectors) = 0;
+  /** @brief デバイスの大きさ（セクタ数）を返す． */
+  virtual uint64_t NumSectors() const = 0;
+};
+
+/** @brief メモリ上に置かれたボリュームイメージをブロックデバイスとして見せる． */
+class RamBlockDevice : public BlockDevice {
+ public:
+  RamBlockDevice(void* image, uint64_t num_sectors);
+  Error Read(uint64_t lba, void* buf, size_t num_sectors) override;
+  Error Write(uint64_t lba, const void* buf, size_t num_sectors) override;
+  uint64_t NumSectors() const override { return num_sectors_; }
+
+ private:
+  uint8_t* image_;
+  uint64_t num_sectors_;
+};
+
+/** @brief ファイルシステムを置いているブロックデバイス． */
+extern BlockDevice* boot_block_device;
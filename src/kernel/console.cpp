@@ -26,9 +26,6 @@ void Console::PutString(const char* s) {
     }
     ++s;
   }
-  if (layer_manager) {
-    layer_manager->Draw(layer_id_);
-  }
 }
 
 void Console::SetWriter(PixelWriter* writer) {
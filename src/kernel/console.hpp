@@ -9,6 +9,7 @@ class Console {
   static const int kRows = 25, kColumns = 80;
 
   Console(const PixelColor& fg_color, const PixelColor& bg_color);
+  /** @brief 文字列をウィンドウに書き込む．画面への反映（レイヤの描画）は呼び出し側で行う． */
   void PutString(const char* s);
   void SetWriter(PixelWriter* writer);
   void SetWindow(const std::shared_ptr<Window>& window);
@@ -1,9 +1,16 @@
 #include "fat.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <cctype>
+#include <iterator>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include "app_cache.hpp"
+#include "rtc.hpp"
 
 namespace {
 
@@ -28,11 +35,332 @@ namespace fat {
 BPB* boot_volume_image;
 unsigned long bytes_per_cluster;
 
+namespace {
+
+/** @brief クラスタの使用状況を 1 クラスタ 1 ビットで表すビットマップ（1 が使用中）。
+ *
+ * FAT を先頭から走査して空きを探す代わりに，このビットマップを 64 クラスタずつ調べる。
+ */
+std::vector<uint64_t> cluster_bitmap;
+unsigned long num_clusters;  // 有効なクラスタ番号の上限（この値は含まない）
+unsigned long num_free_clusters;
+unsigned long next_free_hint;
+FSInfo* fs_info;
+
+bool ClusterInUse(unsigned long cluster) {
+  return (cluster_bitmap[cluster / 64] >> (cluster % 64)) & 1;
+}
+
+void SetClusterInUse(unsigned long cluster) {
+  cluster_bitmap[cluster / 64] |= uint64_t{1} << (cluster % 64);
+}
+
+struct FreeRun {
+  unsigned long start;
+  size_t len;
+};
+
+/** @brief [begin, end) から長さ n の空き領域を探す。
+ *
+ * 見つからなくても，それまでに見つけた最長の空き領域を best に残す。
+ */
+bool ScanFreeRun(unsigned long begin, unsigned long end, size_t n, FreeRun& best) {
+  FreeRun run{begin, 0};
+  unsigned long cluster = begin;
+  while (cluster < end) {
+    if (cluster % 64 == 0 && cluster_bitmap[cluster / 64] == ~uint64_t{0}) {
+      run.len = 0;
+      cluster += 64;
+      continue;
+    }
+    if (ClusterInUse(cluster)) {
+      run.len = 0;
+      ++cluster;
+      continue;
+    }
+
+    if (run.len == 0) {
+      run.start = cluster;
+    }
+    ++run.len;
+    if (run.len > best.len) {
+      best = run;
+    }
+    if (run.len == n) {
+      return true;
+    }
+    ++cluster;
+  }
+  return false;
+}
+
+/** @brief hint 以降（末尾まで行ったら先頭へ戻る）から長さ n の空き領域を探す。
+ *
+ * 見つからなければ最長の空き領域を返す。空きが無ければ長さ 0 を返す。
+ */
+FreeRun FindFreeRun(unsigned long hint, size_t n) {
+  FreeRun best{0, 0};
+  if (!ScanFreeRun(hint, num_clusters, n, best)) {
+    ScanFreeRun(2, hint, n, best);
+  }
+  return best;
+}
+
+/** @brief n 個のクラスタを確保し，prev の後ろにつなぐ。
+ *
+ * @param prev  チェーンの末尾クラスタ。0 なら新しいチェーンを作る。
+ * @return 確保した先頭クラスタと，つないだ後の末尾クラスタ（確保できなければ {0, prev}）
+ */
+std::pair<unsigned long, unsigned long> AllocateClusters(unsigned long prev, size_t n) {
+  uint32_t* fat = GetFAT();
+  unsigned long first = 0;
+
+  // 直前のクラスタの続きが空いていれば，そこから確保してチェーンを連続させる
+  unsigned long hint = next_free_hint;
+  if (prev != 0 && prev + 1 < num_clusters && !ClusterInUse(prev + 1)) {
+    hint = prev + 1;
+  }
+
+  size_t num_allocated = 0;
+  while (num_allocated < n) {
+    const auto run = FindFreeRun(hint, n - num_allocated);
+    if (run.len == 0) {
+      break;
+    }
+
+    const auto last = run.start + run.len - 1;
+    for (auto cluster = run.start; cluster < last; ++cluster) {
+      SetClusterInUse(cluster);
+      fat[cluster] = cluster + 1;
+    }
+    SetClusterInUse(last);
+    fat[last] = kEndOfClusterchain;
+
+    if (prev != 0) {
+      fat[prev] = run.start;
+    }
+    if (first == 0) {
+      first = run.start;
+    }
+    prev = last;
+    num_allocated += run.len;
+    hint = last + 1 < num_clusters ? last + 1 : 2;
+  }
+
+  num_free_clusters -= num_allocated;
+  next_free_hint = hint;
+  if (fs_info) {
+    fs_info->free_count = num_free_clusters;
+    fs_info->next_free = next_free_hint;
+  }
+  return {first, prev};
+}
+
+/** @brief ファイル名を 8.3 形式のディレクトリエントリ名（大文字，空白埋め）に変換する。 */
+void ToName83(const char* name, unsigned char name83[11]) {
+  memset(name83, 0x20, 11);
+
+  int i = 0;
+  int i83 = 0;
+  for (; name[i] != 0 && i83 < 11; ++i, ++i83) {
+    if (name[i] == '.') {
+      i83 = 7;
+      continue;
+    }
+    name83[i83] = toupper(name[i]);
+  }
+}
+
+struct DentryKey {
+  unsigned long dir_cluster;
+  std::array<unsigned char, 11> name;
+
+  bool operator==(const DentryKey& rhs) const {
+    return dir_cluster == rhs.dir_cluster && name == rhs.name;
+  }
+};
+
+struct DentryKeyHash {
+  size_t operator()(const DentryKey& key) const {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    auto mix = [&h](uint8_t b) { h = (h ^ b) * 0x100000001b3; };
+    for (int i = 0; i < 8; ++i) {
+      mix(key.dir_cluster >> (8 * i));
+    }
+    for (auto c : key.name) {
+      mix(c);
+    }
+    return h;
+  }
+};
+
+/** @brief (ディレクトリの開始クラスタ, 8.3 名) からディレクトリエントリを引くキャッシュ。
+ *
+ * 見つからなかった名前も nullptr として覚えておく（ネガティブエントリ）。
+ * ディレクトリにエントリを追加するときは，そのディレクトリのキャッシュを捨てる。
+ */
+std::unordered_map<DentryKey, DirectoryEntry*, DentryKeyHash> dentry_cache;
+bool dentry_cache_enabled = true;
+const size_t kMaxDentries = 8192;
+
+DirectoryEntry* ScanDirectory(unsigned long dir_cluster, const unsigned char name83[11]) {
+  while (dir_cluster != kEndOfClusterchain) {
+    auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
+    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
+      if (dir[i].name[0] == 0x00) {
+        return nullptr;
+      } else if (memcmp(dir[i].name, name83, 11) == 0) {
+        return &dir[i];
+      }
+    }
+    dir_cluster = NextCluster(dir_cluster);
+  }
+  return nullptr;
+}
+
+DirectoryEntry* LookupEntry(unsigned long dir_cluster, const unsigned char name83[11]) {
+  if (!dentry_cache_enabled) {
+    return ScanDirectory(dir_cluster, name83);
+  }
+
+  DentryKey key{dir_cluster, {}};
+  memcpy(key.name.data(), name83, 11);
+  if (auto it = dentry_cache.find(key); it != dentry_cache.end()) {
+    return it->second;
+  }
+
+  auto entry = ScanDirectory(dir_cluster, name83);
+  if (dentry_cache.size() >= kMaxDentries) {
+    dentry_cache.clear();
+  }
+  dentry_cache.emplace(key, entry);
+  return entry;
+}
+
+void InvalidateDentries(unsigned long dir_cluster) {
+  for (auto it = dentry_cache.begin(); it != dentry_cache.end();) {
+    if (it->first.dir_cluster == dir_cluster) {
+      it = dentry_cache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void InitializeClusterBitmap() {
+  const auto& bpb = *boot_volume_image;
+  const unsigned long total_sectors =
+    bpb.total_sectors_32 != 0 ? bpb.total_sectors_32 : bpb.total_sectors_16;
+  const unsigned long data_sectors = total_sectors -
+    bpb.reserved_sector_count - bpb.num_fats * bpb.fat_size_32;
+  num_clusters = std::min<unsigned long>(
+      data_sectors / bpb.sectors_per_cluster + 2,
+      bpb.fat_size_32 * bpb.bytes_per_sector / sizeof(uint32_t));
+
+  // 範囲外のビットは使用中にしておき，64 クラスタ単位の読み飛ばしで拾わないようにする
+  cluster_bitmap.assign((num_clusters + 63) / 64, ~uint64_t{0});
+  const uint32_t* fat = GetFAT();
+  num_free_clusters = 0;
+  for (unsigned long cluster = 2; cluster < num_clusters; ++cluster) {
+    if (fat[cluster] == 0) {
+      cluster_bitmap[cluster / 64] &= ~(uint64_t{1} << (cluster % 64));
+      ++num_free_clusters;
+    }
+  }
+
+  next_free_hint = 2;
+  auto info = reinterpret_cast<FSInfo*>(
+      reinterpret_cast<uintptr_t>(boot_volume_image) +
+      bpb.fs_info * bpb.bytes_per_sector);
+  if (bpb.fs_info != 0 &&
+      info->lead_signature == 0x41615252 &&
+      info->struct_signature == 0x61417272 &&
+      info->trail_signature == 0xaa550000) {
+    fs_info = info;
+    if (2 <= fs_info->next_free && fs_info->next_free < num_clusters) {
+      next_free_hint = fs_info->next_free;
+    }
+    fs_info->free_count = num_free_clusters;
+    fs_info->next_free = next_free_hint;
+  }
+}
+
+/** @brief cluster から始まるチェーンのクラスタをすべて空きに戻す。 */
+void FreeClusterChain(unsigned long cluster) {
+  uint32_t* fat = GetFAT();
+  while (2 <= cluster && cluster < num_clusters) {
+    const unsigned long next = fat[cluster];
+    fat[cluster] = 0;
+    cluster_bitmap[cluster / 64] &= ~(uint64_t{1} << (cluster % 64));
+    ++num_free_clusters;
+    if (IsEndOfClusterchain(next)) {
+      break;
+    }
+    cluster = next;
+  }
+
+  if (fs_info) {
+    fs_info->free_count = num_free_clusters;
+  }
+}
+
+/** @brief path の親ディレクトリの開始クラスタと，最後の要素の名前を返す。
+ *
+ * 親ディレクトリが見つからなければ開始クラスタとして 0 を返す。
+ */
+std::pair<unsigned long, const char*> SplitParent(const char* path) {
+  const unsigned long root_cluster = boot_volume_image->root_cluster;
+  const char* slash_pos = strrchr(path, '/');
+  if (slash_pos == nullptr) {
+    return {root_cluster, path};
+  }
+
+  char parent_dir_name[slash_pos - path + 1];
+  strncpy(parent_dir_name, path, slash_pos - path);
+  parent_dir_name[slash_pos - path] = '\0';
+  if (parent_dir_name[0] == '\0') {
+    return {root_cluster, &slash_pos[1]};
+  }
+
+  auto [parent_dir, post_slash] = FindFile(parent_dir_name);
+  if (parent_dir == nullptr || parent_dir->attr != Attribute::kDirectory) {
+    return {0, &slash_pos[1]};
+  }
+  return {parent_dir->FirstCluster(), &slash_pos[1]};
+}
+
+/** @brief ディレクトリに "." と ".." 以外の（削除済みでない）エントリがあれば true。 */
+bool DirectoryHasEntries(unsigned long dir_cluster) {
+  while (dir_cluster != kEndOfClusterchain) {
+    auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
+    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
+      if (dir[i].name[0] == 0x00) {
+        return false;
+      } else if (dir[i].name[0] != 0xe5 && dir[i].name[0] != '.') {
+        return true;
+      }
+    }
+    dir_cluster = NextCluster(dir_cluster);
+  }
+  return false;
+}
+
+/** @brief エントリの最終更新日時を RTC の現在時刻にする。 */
+void UpdateWriteTime(DirectoryEntry& entry) {
+  const auto t = ReadRTC();
+  entry.write_date = (t.year - 1980) << 9 | t.month << 5 | t.day;
+  entry.write_time = t.hour << 11 | t.minute << 5 | t.second / 2;
+}
+
+} // namespace
+
 void Initialize(void* volume_image) {
   boot_volume_image = reinterpret_cast<fat::BPB*>(volume_image);
   bytes_per_cluster =
     static_cast<unsigned long>(boot_volume_image->bytes_per_sector) *
     boot_volume_image->sectors_per_cluster;
+  InitializeClusterBitmap();
 }
 
 uintptr_t GetClusterAddr(unsigned long cluster) {
@@ -92,46 +420,30 @@ FindFile(const char* path, unsigned long directory_cluster) {
   const auto [next_path, post_slash] = NextPathElement(path, path_elem);
   const bool path_last = next_path == nullptr || next_path[0] == '\0';
 
-  while (directory_cluster != kEndOfClusterchain) {
-    auto dir = GetSectorByCluster<DirectoryEntry>(directory_cluster);
-    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
-      if (dir[i].name[0] == 0x00) {
-        goto not_found;
-      } else if (!NameIsEqual(dir[i], path_elem)) {
-        continue;
-      }
-
-      if (dir[i].attr == Attribute::kDirectory && !path_last) {
-        return FindFile(next_path, dir[i].FirstCluster());
-      } else {
-        return {&dir[i], post_slash};
-      }
-    }
-
-    directory_cluster = NextCluster(directory_cluster);
+  unsigned char name83[11];
+  ToName83(path_elem, name83);
+  auto entry = LookupEntry(directory_cluster, name83);
+  if (entry == nullptr) {
+    return {nullptr, post_slash};
   }
 
-not_found:
-  return {nullptr, post_slash};
+  if (entry->attr == Attribute::kDirectory && !path_last) {
+    return FindFile(next_path, entry->FirstCluster());
+  }
+  return {entry, post_slash};
 }
 
 bool NameIsEqual(const DirectoryEntry& entry, const char* name) {
   unsigned char name83[11];
-  memset(name83, 0x20, sizeof(name83));
-
-  int i = 0;
-  int i83 = 0;
-  for (; name[i] != 0 && i83 < sizeof(name83); ++i, ++i83) {
-    if (name[i] == '.') {
-      i83 = 7;
-      continue;
-    }
-    name83[i83] = toupper(name[i]);
-  }
-
+  ToName83(name, name83);
   return memcmp(entry.name, name83, sizeof(name83)) == 0;
 }
 
+void SetDentryCacheEnabled(bool enabled) {
+  dentry_cache_enabled = enabled;
+  dentry_cache.clear();
+}
+
 size_t LoadFile(void* buf, size_t len, DirectoryEntry& entry) {
   return FileDescriptor{entry}.Read(buf, len);
 }
@@ -152,23 +464,21 @@ unsigned long ExtendCluster(unsigned long eoc_cluster, size_t n) {
   while (!IsEndOfClusterchain(fat[eoc_cluster])) {
     eoc_cluster = fat[eoc_cluster];
   }
+  return AllocateClusters(eoc_cluster, n).second;
+}
 
-  size_t num_allocated = 0;
-  auto current = eoc_cluster;
+unsigned long AllocateClusterChain(size_t n) {
+  return AllocateClusters(0, n).first;
+}
 
-  for (unsigned long candidate = 2; num_allocated < n; ++candidate) {
-    if (fat[candidate] != 0) {
-      continue;
-    }
-    fat[current] = candidate;
-    current = candidate;
-    ++num_allocated;
-  }
-  fat[current] = kEndOfClusterchain;
-  return current;
+unsigned long CountFreeClusters() {
+  return num_free_clusters;
 }
 
 DirectoryEntry* AllocateEntry(unsigned long dir_cluster) {
+  // 新しいエントリには呼び出し側が名前を付けるので，ネガティブエントリが古くなる
+  InvalidateDentries(dir_cluster);
+
   while (true) {
     auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
     for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
@@ -183,7 +493,11 @@ DirectoryEntry* AllocateEntry(unsigned long dir_cluster) {
     dir_cluster = next;
   }
 
-  dir_cluster = ExtendCluster(dir_cluster, 1);
+  const auto new_cluster = ExtendCluster(dir_cluster, 1);
+  if (new_cluster == dir_cluster) {
+    return nullptr;
+  }
+  dir_cluster = new_cluster;
   auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
   memset(dir, 0, bytes_per_cluster);
   return &dir[0];
@@ -207,78 +521,98 @@ void SetFileName(DirectoryEntry& entry, const char* name) {
 }
 
 WithError<DirectoryEntry*> CreateFile(const char* path) {
-  auto parent_dir_cluster = fat::boot_volume_image->root_cluster;
-  const char* filename = path;
-
-  if (const char* slash_pos = strrchr(path, '/')) {
-    filename = &slash_pos[1];
-    if (slash_pos[1] == '\0') {
-      return {nullptr, MAKE_ERROR(Error::kIsDirectory)};
-    }
-
-    char parent_dir_name[slash_pos - path + 1];
-    strncpy(parent_dir_name, path, slash_pos - path);
-    parent_dir_name[slash_pos - path] = '\0';
-
-    if (parent_dir_name[0] != '\0') {
-      auto [parent_dir, post_slash2] = fat::FindFile(parent_dir_name);
-      if (parent_dir == nullptr) {
-        return {nullptr, MAKE_ERROR(Error::kNoSuchEntry)};
-      }
-      parent_dir_cluster = parent_dir->FirstCluster();
-    }
+  const auto [ parent_dir_cluster, filename ] = SplitParent(path);
+  if (filename[0] == '\0') {
+    return {nullptr, MAKE_ERROR(Error::kIsDirectory)};
+  }
+  if (parent_dir_cluster == 0) {
+    return {nullptr, MAKE_ERROR(Error::kNoSuchEntry)};
   }
 
   auto dir = fat::AllocateEntry(parent_dir_cluster);
   if (dir == nullptr) {
     return {nullptr, MAKE_ERROR(Error::kNoEnoughMemory)};
   }
+  // 削除済みのエントリを再利用することがあるので，古い属性やクラスタを消しておく
+  memset(dir, 0, sizeof(*dir));
   fat::SetFileName(*dir, filename);
-  dir->file_size = 0;
   return {dir, MAKE_ERROR(Error::kSuccess)};
 }
 
-FileDescriptor::FileDescriptor(DirectoryEntry& fat_entry): fat_entry_{fat_entry} {}
+WithError<DirectoryEntry*> CreateDirectory(const char* path) {
+  const auto parent_dir_cluster = SplitParent(path).first;
+  const auto dir_cluster = AllocateClusterChain(1);
+  if (dir_cluster == 0) {
+    return {nullptr, MAKE_ERROR(Error::kNoEnoughMemory)};
+  }
 
-size_t FileDescriptor::Read(void* buf, size_t len) {
-  if (rd_cluster_ == 0) {
-    rd_cluster_ = fat_entry_.FirstCluster();
+  auto [ entry, err ] = CreateFile(path);
+  if (err) {
+    FreeClusterChain(dir_cluster);
+    return {nullptr, err};
   }
-  uint8_t* buf8 = reinterpret_cast<uint8_t*>(buf);
-  len = std::min(len, fat_entry_.file_size - rd_off_);
 
-  size_t total = 0;
-  while (total < len) {
-    uint8_t* sec = GetSectorByCluster<uint8_t>(rd_cluster_);
-    size_t n = std::min(len - total, bytes_per_cluster - rd_cluster_off_);
-    memcpy(&buf8[total], &sec[rd_cluster_off_], n);
-    total += n;
+  auto dir = GetSectorByCluster<DirectoryEntry>(dir_cluster);
+  memset(dir, 0, bytes_per_cluster);
+  auto set_dot_entry = [](DirectoryEntry& e, const char* name, unsigned long cluster) {
+    memset(e.name, ' ', 11);
+    memcpy(e.name, name, strlen(name));
+    e.attr = Attribute::kDirectory;
+    e.first_cluster_low = cluster & 0xffff;
+    e.first_cluster_high = cluster >> 16;
+    UpdateWriteTime(e);
+  };
+  // ルートディレクトリを指す ".." の開始クラスタは 0 とする決まり
+  set_dot_entry(dir[0], ".", dir_cluster);
+  set_dot_entry(dir[1], "..",
+      parent_dir_cluster == boot_volume_image->root_cluster ? 0 : parent_dir_cluster);
+
+  entry->attr = Attribute::kDirectory;
+  entry->first_cluster_low = dir_cluster & 0xffff;
+  entry->first_cluster_high = dir_cluster >> 16;
+  UpdateWriteTime(*entry);
+  return {entry, MAKE_ERROR(Error::kSuccess)};
+}
 
-    rd_cluster_off_ += n;
-    if (rd_cluster_off_ == bytes_per_cluster) {
-      rd_cluster_ = NextCluster(rd_cluster_);
-      rd_cluster_off_ = 0;
+Error RemoveFile(const char* path) {
+  const auto [ parent_dir_cluster, filename ] = SplitParent(path);
+  if (parent_dir_cluster == 0) {
+    return MAKE_ERROR(Error::kNoSuchEntry);
+  }
+  unsigned char name83[11];
+  ToName83(filename, name83);
+  auto entry = ScanDirectory(parent_dir_cluster, name83);
+  if (entry == nullptr) {
+    return MAKE_ERROR(Error::kNoSuchEntry);
+  }
+
+  const auto cluster = entry->FirstCluster();
+  if (auto err = PrepareAppFileWrite(cluster)) {
+    // 実行中のアプリが解放後のクラスタから読んでしまわないようにする
+    return err;
+  }
+  if (entry->attr == Attribute::kDirectory) {
+    if (DirectoryHasEntries(cluster)) {
+      return MAKE_ERROR(Error::kDirectoryNotEmpty);
     }
+    // 解放したクラスタが別のディレクトリに使われても古いエントリを引かないようにする
+    InvalidateDentries(cluster);
+  }
+  if (cluster != 0) {
+    FreeClusterChain(cluster);
   }
 
-  rd_off_ += total;
-  return total;
+  entry->name[0] = 0xe5;
+  InvalidateDentries(parent_dir_cluster);
+  return MAKE_ERROR(Error::kSuccess);
 }
 
-unsigned long AllocateClusterChain(size_t n) {
-  uint32_t* fat = GetFAT();
-  unsigned long first_cluster;
-  for (first_cluster = 2; ; ++first_cluster) {
-    if (fat[first_cluster] == 0) {
-      fat[first_cluster] = kEndOfClusterchain;
-      break;
-    }
-  }
+FileDescriptor::FileDescriptor(DirectoryEntry& fat_entry): fat_entry_{fat_entry} {}
 
-  if (n > 1) {
-    ExtendCluster(first_cluster, n - 1);
-  }
-  return first_cluster;
+size_t FileDescriptor::Read(void* buf, size_t len) {
+  const size_t n = ReadAt(buf, len, rd_off_);
+  rd_off_ += n;
+  return n;
 }
 
 size_t FileDescriptor::Write(const void* buf, size_t len) {
@@ -286,36 +620,37 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
     return (bytes + bytes_per_cluster - 1) / bytes_per_cluster;
   };
 
-  if (wr_cluster_ == 0) {
-    if (fat_entry_.FirstCluster() != 0) {
-      wr_cluster_ = fat_entry_.FirstCluster();
-    } else {
-      wr_cluster_ = AllocateClusterChain(num_cluster(len));
-      fat_entry_.first_cluster_low = wr_cluster_ & 0xffff;
-      fat_entry_.first_cluster_high = (wr_cluster_ >> 16) & 0xffff;
-    }
+  if (len == 0) {
+    return 0;
+  }
+  // 実行中のアプリがこのファイルから読むページを，書き換える前に読み込んでおく
+  // 読み込めなければ，書き換え後の内容が混ざらないよう書き込まない
+  if (PrepareAppFileWrite(fat_entry_.FirstCluster())) {
+    return 0;
   }
+  if (!write_time_updated_) {
+    // 最終更新日時はこのディスクリプタで最初に書いたときだけ更新する
+    UpdateWriteTime(fat_entry_);
+    write_time_updated_ = true;
+  }
+  EnsureClusters(num_cluster(wr_off_ + len));
 
   const uint8_t* buf8 = reinterpret_cast<const uint8_t*>(buf);
 
   size_t total = 0;
   while (total < len) {
-    if (wr_cluster_off_ == bytes_per_cluster) {
-      const auto next_cluster = NextCluster(wr_cluster_);
-      if (next_cluster == kEndOfClusterchain) {
-        wr_cluster_ = ExtendCluster(wr_cluster_, num_cluster(len - total));
-      } else {
-        wr_cluster_ = next_cluster;
-      }
-      wr_cluster_off_ = 0;
+    const size_t pos = wr_off_ + total;
+    const Extent* ext = FindExtent(pos / bytes_per_cluster);
+    if (ext == nullptr) {
+      // ボリュームに空きが無い
+      break;
     }
-
-    uint8_t* sec = GetSectorByCluster<uint8_t>(wr_cluster_);
-    size_t n = std::min(len, bytes_per_cluster - wr_cluster_off_);
-    memcpy(&sec[wr_cluster_off_], &buf8[total], n);
+    const size_t ext_off = pos - ext->index * bytes_per_cluster;
+    const size_t n = std::min(len - total,
+                              ext->num_clusters * bytes_per_cluster - ext_off);
+    uint8_t* sec = GetSectorByCluster<uint8_t>(ext->cluster);
+    memcpy(&sec[ext_off], &buf8[total], n);
     total += n;
-
-    wr_cluster_off_ += n;
   }
 
   wr_off_ += total;
@@ -324,18 +659,78 @@ size_t FileDescriptor::Write(const void* buf, size_t len) {
 }
 
 size_t FileDescriptor::Load(void* buf, size_t len, size_t offset) {
-  FileDescriptor fd{fat_entry_};
-  fd.rd_off_ = offset;
+  return ReadAt(buf, len, offset);
+}
 
-  unsigned long cluster = fat_entry_.FirstCluster();
-  while (offset >= bytes_per_cluster) {
-    offset -= bytes_per_cluster;
-    cluster = NextCluster(cluster);
+const FileDescriptor::Extent* FileDescriptor::FindExtent(size_t index) {
+  if (extents_.empty()) {
+    const auto first_cluster = fat_entry_.FirstCluster();
+    if (first_cluster == 0) {
+      return nullptr;
+    }
+    extents_.push_back({0, first_cluster, 1});
+  }
+
+  while (index >= extents_.back().index + extents_.back().num_clusters) {
+    auto& last = extents_.back();
+    const auto next_index = last.index + last.num_clusters;
+    const auto next = NextCluster(last.cluster + last.num_clusters - 1);
+    if (next == kEndOfClusterchain) {
+      return nullptr;
+    }
+    if (next == last.cluster + last.num_clusters) {
+      ++last.num_clusters;
+    } else {
+      extents_.push_back({next_index, next, 1});
+    }
   }
 
-  fd.rd_cluster_ = cluster;
-  fd.rd_cluster_off_ = offset;
-  return fd.Read(buf, len);
+  auto it = std::upper_bound(
+      extents_.begin(), extents_.end(), index,
+      [](size_t i, const Extent& ext) { return i < ext.index; });
+  return &*std::prev(it);
+}
+
+void FileDescriptor::EnsureClusters(size_t n) {
+  if (fat_entry_.FirstCluster() == 0) {
+    const auto first_cluster = AllocateClusterChain(n);
+    fat_entry_.first_cluster_low = first_cluster & 0xffff;
+    fat_entry_.first_cluster_high = (first_cluster >> 16) & 0xffff;
+    return;
+  }
+
+  if (FindExtent(n - 1)) {
+    return;
+  }
+  // FindExtent が nullptr を返したので，extents_ はチェーンの末尾まで伸びている
+  const auto& last = extents_.back();
+  ExtendCluster(last.cluster + last.num_clusters - 1,
+                n - (last.index + last.num_clusters));
+}
+
+size_t FileDescriptor::ReadAt(void* buf, size_t len, size_t offset) {
+  if (offset >= fat_entry_.file_size) {
+    return 0;
+  }
+  uint8_t* buf8 = reinterpret_cast<uint8_t*>(buf);
+  len = std::min(len, fat_entry_.file_size - offset);
+
+  size_t total = 0;
+  while (total < len) {
+    const size_t pos = offset + total;
+    const Extent* ext = FindExtent(pos / bytes_per_cluster);
+    if (ext == nullptr) {
+      break;
+    }
+    const size_t ext_off = pos - ext->index * bytes_per_cluster;
+    const size_t n = std::min(len - total,
+                              ext->num_clusters * bytes_per_cluster - ext_off);
+    const uint8_t* sec = GetSectorByCluster<uint8_t>(ext->cluster);
+    memcpy(&buf8[total], &sec[ext_off], n);
+    total += n;
+  }
+
+  return total;
 }
 
 } // namespace fat
@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 
 #include "error.hpp"
 #include "file.hpp"
@@ -44,6 +45,16 @@ struct BPB {
   char fs_type[8];
 } __attribute__((packed));
 
+struct FSInfo {
+  uint32_t lead_signature;
+  uint8_t reserved1[480];
+  uint32_t struct_signature;
+  uint32_t free_count;
+  uint32_t next_free;
+  uint8_t reserved2[12];
+  uint32_t trail_signature;
+} __attribute__((packed));
+
 enum class Attribute : uint8_t {
   kReadOnly  = 0x01,
   kHidden    = 0x02,
@@ -126,6 +137,12 @@ FindFile(const char* path, unsigned long directory_cluster = 0);
 
 bool NameIsEqual(const DirectoryEntry& entry, const char* name);
 
+/** @brief FindFile が使うディレクトリエントリのキャッシュを有効／無効にする。
+ *
+ * 切り替えるとキャッシュの内容は捨てられる。性能測定用。
+ */
+void SetDentryCacheEnabled(bool enabled);
+
 /** @brief 指定されたファイルの内容をバッファへコピーする。
  *
  * @param buf  ファイル内容の格納先
@@ -139,14 +156,43 @@ bool IsEndOfClusterchain(unsigned long cluster);
 
 uint32_t* GetFAT();
 
+/** @brief クラスタチェーンの末尾に n 個のクラスタを追加する。
+ *
+ * 空きクラスタはなるべく連続した領域から確保する。
+ * ボリュームの空きが足りなければ確保できた分だけ追加する。
+ *
+ * @param eoc_cluster  伸ばすチェーンに属するクラスタ（末尾のクラスタを渡すとチェーンを辿らずに済む）
+ * @return 伸ばした後のチェーン末尾のクラスタ番号
+ */
 unsigned long ExtendCluster(unsigned long eoc_cluster, size_t n);
 
+/** @brief n 個のクラスタからなる新しいクラスタチェーンを確保する。
+ *
+ * @return チェーンの先頭クラスタ番号。空きクラスタが無ければ 0。
+ */
+unsigned long AllocateClusterChain(size_t n);
+
+/** @brief 空きクラスタの数を返す。 */
+unsigned long CountFreeClusters();
+
 DirectoryEntry* AllocateEntry(unsigned long dir_cluster);
 
 void SetFileName(DirectoryEntry& entry, const char* name);
 
 WithError<DirectoryEntry*> CreateFile(const char* path);
 
+/** @brief 空のディレクトリを作る。
+ *
+ * @return 作ったディレクトリを表すエントリ
+ */
+WithError<DirectoryEntry*> CreateDirectory(const char* path);
+
+/** @brief ファイルか空のディレクトリを削除し，そのクラスタを解放する。
+ *
+ * 空でないディレクトリは削除せず kDirectoryNotEmpty を返す。
+ */
+Error RemoveFile(const char* path);
+
 class FileDescriptor : public ::FileDescriptor {
 public:
   explicit FileDescriptor(DirectoryEntry& fat_entry);
@@ -156,13 +202,33 @@ public:
   size_t Load(void* buf, size_t len, size_t offset) override;
 
 private:
+  /** @brief ディスク上で連続しているクラスタの並び。 */
+  struct Extent {
+    size_t index;           // ファイル先頭から数えたクラスタの番号
+    unsigned long cluster;  // 先頭クラスタ
+    size_t num_clusters;    // 連続しているクラスタの数
+  };
+
+  /** @brief ファイル先頭から index 番目のクラスタを含むエクステントを返す。
+   *
+   * エクステントリストは必要になった分だけクラスタチェーンを辿って作る。
+   * 一度辿った範囲は二分探索で引ける。
+   *
+   * @return エクステント。クラスタチェーンがそこまで続いていなければ nullptr。
+   */
+  const Extent* FindExtent(size_t index);
+
+  /** @brief ファイルが少なくとも n 個のクラスタを持つようにチェーンを伸ばす。 */
+  void EnsureClusters(size_t n);
+
+  /** @brief offset から len バイトを buf へ読み込む。 */
+  size_t ReadAt(void* buf, size_t len, size_t offset);
+
   DirectoryEntry& fat_entry_;
+  std::vector<Extent> extents_;
   size_t rd_off_ = 0;
-  unsigned long rd_cluster_ = 0;
-  size_t rd_cluster_off_ = 0;
   size_t wr_off_ = 0;
-  unsigned long wr_cluster_ = 0;
-  size_t wr_cluster_off_ = 0;
+  bool write_time_updated_ = false;
 };
 
 } // namespace fat
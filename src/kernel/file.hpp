@@ -3,6 +3,8 @@
 #include <cstddef>
 #include "error.hpp"
 
+class Task;
+
 class FileDescriptor {
 public:
   virtual ~FileDescriptor() = default;
@@ -10,6 +12,20 @@ public:
   virtual size_t Write(const void* buf, size_t len) = 0;
   virtual size_t Size() const = 0;
   virtual size_t Load(void* buf, size_t len, size_t offset) = 0;
+  /** @brief 溜めている出力があれば出力先へ反映する。ブロックする直前などに呼ばれる。 */
+  virtual void Flush() {}
+  /** @brief 読み出しがブロックせずに済むかを返す。割り込み禁止で呼ぶこと。
+   *
+   * 済まない場合は，読めるようになったときに task を起こすよう登録する。
+   * 登録は CancelPoll で取り消す。
+   */
+  virtual bool PollRead(Task& task) { return true; }
+  /** @brief 書き込みがブロックせずに済むかを返す。登録の扱いは PollRead と同じ。 */
+  virtual bool PollWrite(Task& task) { return true; }
+  /** @brief PollRead/PollWrite で登録した task を取り消す。割り込み禁止で呼ぶこと。 */
+  virtual void CancelPoll(Task& task) {}
+  /** @brief 端末につながっていれば true を返す。 */
+  virtual bool IsTerminal() const { return false; }
 };
 
 size_t PrintToFD(FileDescriptor& fd, const char* format, ...);
@@ -1,5 +1,7 @@
 #include "frame_buffer.hpp"
 
+#include <immintrin.h>
+
 namespace {
   int BytesPerPixel(PixelFormat format) {
     switch (format) {
@@ -22,6 +24,45 @@ namespace {
     return {static_cast<int>(config.horizontal_resolution),
             static_cast<int>(config.vertical_resolution)};
   }
+
+  /** @brief キャッシュを汚さない非テンポラルストア（movntdq）で 1 行分をコピーする．
+   *
+   * WC でマップされたフレームバッファへの書き込み用．
+   * dst は 4 バイト境界にあることを前提とする．
+   */
+  void CopyLineNonTemporal(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    // 16 バイト境界に揃うまでは 4 バイトずつ書く
+    while (bytes >= 4 && (reinterpret_cast<uintptr_t>(dst) & 15) != 0) {
+      int v;
+      memcpy(&v, src, 4);
+      _mm_stream_si32(reinterpret_cast<int*>(dst), v);
+      dst += 4; src += 4; bytes -= 4;
+    }
+    while (bytes >= 64) {
+      const auto s = reinterpret_cast<const __m128i*>(src);
+      auto d = reinterpret_cast<__m128i*>(dst);
+      const __m128i v0 = _mm_loadu_si128(s + 0);
+      const __m128i v1 = _mm_loadu_si128(s + 1);
+      const __m128i v2 = _mm_loadu_si128(s + 2);
+      const __m128i v3 = _mm_loadu_si128(s + 3);
+      _mm_stream_si128(d + 0, v0);
+      _mm_stream_si128(d + 1, v1);
+      _mm_stream_si128(d + 2, v2);
+      _mm_stream_si128(d + 3, v3);
+      dst += 64; src += 64; bytes -= 64;
+    }
+    while (bytes >= 16) {
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+      dst += 16; src += 16; bytes -= 16;
+    }
+    while (bytes >= 4) {
+      int v;
+      memcpy(&v, src, 4);
+      _mm_stream_si32(reinterpret_cast<int*>(dst), v);
+      dst += 4; src += 4; bytes -= 4;
+    }
+  }
 }
 
 Error FrameBuffer::Initialize(const FrameBufferConfig& config) {
@@ -76,6 +117,17 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src,
   uint8_t* dst_buf = FrameAddrAt(copy_area.pos, config_);
   const uint8_t* src_buf = FrameAddrAt(src_start_pos, src.config_);
 
+  // 自前のバッファを持たない＝ハードウェアのフレームバッファへの転送
+  if (buffer_.empty()) {
+    for (int y = 0; y < copy_area.size.y; ++y) {
+      CopyLineNonTemporal(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
+      dst_buf += BytesPerScanLine(config_);
+      src_buf += BytesPerScanLine(src.config_);
+    }
+    _mm_sfence();
+    return MAKE_ERROR(Error::kSuccess);
+  }
+
   for (int y = 0; y < copy_area.size.y; ++y) {
     memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
     dst_buf += BytesPerScanLine(config_);
@@ -89,11 +141,12 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
   const auto bytes_per_pixel = BytesPerPixel(config_.pixel_format);
   const auto bytes_per_scan_line = BytesPerScanLine(config_);
 
+  // 横方向の移動では同じ行の中で移動元と移動先が重なるので memmove を使う
   if (dst_pos.y < src.pos.y) { // move up
     uint8_t* dst_buf = FrameAddrAt(dst_pos, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      memmove(dst_buf, src_buf, bytes_per_pixel * src.size.x);
       dst_buf += bytes_per_scan_line;
       src_buf += bytes_per_scan_line;
     }
@@ -101,7 +154,7 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     uint8_t* dst_buf = FrameAddrAt(dst_pos + Vector2D<int>{0, src.size.y - 1}, config_);
     const uint8_t* src_buf = FrameAddrAt(src.pos + Vector2D<int>{0, src.size.y - 1}, config_);
     for (int y = 0; y < src.size.y; ++y) {
-      memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+      memmove(dst_buf, src_buf, bytes_per_pixel * src.size.x);
       dst_buf -= bytes_per_scan_line;
       src_buf -= bytes_per_scan_line;
     }
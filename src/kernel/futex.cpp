@@ -0,0 +1,95 @@
+/**
+ * @file futex.cpp
+ *
+ * futex の実装．
+ */
+
+#include "futex.hpp"
+
+#include <algorithm>
+#include <deque>
+
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+  /** @brief 待っているタスク 1 つ．待っているタスクのスタック上に置く． */
+  struct FutexWaiter {
+    AppProcess* process;
+    uintptr_t addr;
+    Task* task;
+    bool woken;
+  };
+
+  // 待ちの数は少ないので，登録順に並べて線形に探す
+  std::deque<FutexWaiter*>* waiters;
+
+  void RemoveWaiter(FutexWaiter* waiter) {
+    waiters->erase(std::remove(waiters->begin(), waiters->end(), waiter),
+                   waiters->end());
+  }
+}
+
+Error FutexWait(Task& task, const uint32_t* addr, uint32_t expected,
+                unsigned long deadline) {
+  // 割り込み禁止中にページフォールトで読み込みが起きないよう，先に触っておく
+  static_cast<void>(*reinterpret_cast<const volatile uint32_t*>(addr));
+
+  FutexWaiter waiter{task.Process().get(), reinterpret_cast<uintptr_t>(addr),
+                     &task, false};
+
+  __asm__("cli");
+  if (*reinterpret_cast<const volatile uint32_t*>(addr) != expected) {
+    __asm__("sti");
+    return MAKE_ERROR(Error::kValueChanged);
+  }
+  if (waiters == nullptr) {
+    waiters = new std::deque<FutexWaiter*>;
+  }
+  waiters->push_back(&waiter);
+  if (deadline != 0) {
+    timer_manager->AddTimer(Timer{deadline, kWakeupTimerValue, task.ID()});
+  }
+
+  while (!waiter.woken) {
+    if (deadline != 0 && timer_manager->CurrentTick() >= deadline) {
+      RemoveWaiter(&waiter);
+      __asm__("sti");
+      return MAKE_ERROR(Error::kTimedOut);
+    }
+    if (task.KillPending()) {
+      RemoveWaiter(&waiter);
+      __asm__("sti");
+      return MAKE_ERROR(Error::kInterrupted);
+    }
+    task.Sleep();
+    __asm__("cli");
+  }
+  __asm__("sti");
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+size_t FutexWake(Task& task, const uint32_t* addr, size_t num) {
+  const auto process = task.Process().get();
+  const auto key = reinterpret_cast<uintptr_t>(addr);
+  size_t num_woken = 0;
+
+  __asm__("cli");
+  if (waiters == nullptr) {
+    __asm__("sti");
+    return 0;
+  }
+  for (auto it = waiters->begin(); it != waiters->end() && num_woken < num;) {
+    auto waiter = *it;
+    if (waiter->process != process || waiter->addr != key) {
+      ++it;
+      continue;
+    }
+    it = waiters->erase(it);
+    waiter->woken = true;
+    waiter->task->Wakeup();
+    ++num_woken;
+  }
+  __asm__("sti");
+  return num_woken;
+}
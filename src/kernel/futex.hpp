@@ -0,0 +1,29 @@
+/**
+ * @file futex.hpp
+ *
+ * アプリのアドレスをキーにしてスレッドを待たせる仕組み（futex）．
+ *
+ * 値の確認と待ちへの登録を割り込み禁止のまま行うので，
+ * 確認してから眠るまでの間に起こされ損なうことはない．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
+
+class Task;
+
+/** @brief *addr が expected と等しければ，FutexWake で起こされるか期限が来るまで眠る．
+ *
+ * @param deadline  期限の tick．0 なら期限なしで待つ
+ * @return 値が expected と違えば kValueChanged，期限が来れば kTimedOut，
+ *         task が終了を求められれば kInterrupted
+ */
+Error FutexWait(Task& task, const uint32_t* addr, uint32_t expected,
+                unsigned long deadline);
+
+/** @brief task と同じアプリで addr を待っているタスクを最大 num 個起こし，起こした数を返す． */
+size_t FutexWake(Task& task, const uint32_t* addr, size_t num);
@@ -6,6 +6,11 @@
 
 #include "graphics.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
 void RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& c) {
   auto p = PixelAt(pos);
   p[0] = c.r;
@@ -41,6 +46,142 @@ void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos,
   }
 }
 
+namespace {
+  /** @brief 線分 p0-p1 を [0, width) x [0, height) に収まる部分に切り詰める．
+   *
+   * 線分が範囲と交わらなければ false を返す．
+   * アプリから渡された巨大な座標でも，描く点の数が画面の大きさで抑えられるようにする．
+   */
+  bool ClipLine(Vector2D<int>& p0, Vector2D<int>& p1, int width, int height) {
+    if (width <= 0 || height <= 0) {
+      return false;
+    }
+
+    // Liang-Barsky の方法で，線分のうち範囲内にある区間 [t0, t1] を求める
+    const double x0 = p0.x, y0 = p0.y;
+    const double dx = static_cast<double>(p1.x) - x0;
+    const double dy = static_cast<double>(p1.y) - y0;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {x0, width - 1 - x0, y0, height - 1 - y0};
+    double t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; ++i) {
+      if (p[i] == 0) {
+        if (q[i] < 0) {
+          return false;
+        }
+        continue;
+      }
+      const double r = q[i] / p[i];
+      if (p[i] < 0) {
+        if (r > t1) {
+          return false;
+        }
+        t0 = std::max(t0, r);
+      } else {
+        if (r < t0) {
+          return false;
+        }
+        t1 = std::min(t1, r);
+      }
+    }
+
+    auto point_at = [&](double t) {
+      const int x = static_cast<int>(x0 + t * dx + 0.5);
+      const int y = static_cast<int>(y0 + t * dy + 0.5);
+      return Vector2D<int>{std::clamp(x, 0, width - 1), std::clamp(y, 0, height - 1)};
+    };
+    const auto new_p0 = point_at(t0), new_p1 = point_at(t1);
+    p0 = new_p0;
+    p1 = new_p1;
+    return true;
+  }
+}
+
+void DrawLine(PixelWriter& writer, Vector2D<int> p0, Vector2D<int> p1,
+              const PixelColor& c) {
+  const int width = writer.Width(), height = writer.Height();
+  if (!ClipLine(p0, p1, width, height)) {
+    return;
+  }
+  const int dx = abs(p1.x - p0.x), sx = p0.x < p1.x ? 1 : -1;
+  const int dy = -abs(p1.y - p0.y), sy = p0.y < p1.y ? 1 : -1;
+  int err = dx + dy;
+
+  while (true) {
+    if (0 <= p0.x && p0.x < width && 0 <= p0.y && p0.y < height) {
+      writer.Write(p0, c);
+    }
+    if (p0.x == p1.x && p0.y == p1.y) {
+      break;
+    }
+    const int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      p0.x += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      p0.y += sy;
+    }
+  }
+}
+
+void FillPolygon(PixelWriter& writer, const Vector2D<int>* points,
+                 size_t num_points, const PixelColor& c) {
+  if (num_points == 0) {
+    return;
+  }
+
+  int ymin = std::numeric_limits<int>::max();
+  int ymax = std::numeric_limits<int>::min();
+  for (size_t i = 0; i < num_points; ++i) {
+    ymin = std::min(ymin, points[i].y);
+    ymax = std::max(ymax, points[i].y);
+  }
+  ymin = std::max(ymin, 0);
+  ymax = std::min(ymax, writer.Height() - 1);
+  if (ymin > ymax) {
+    return;
+  }
+
+  // 走査線ごとのスパン [left, right]
+  std::vector<int> left(ymax - ymin + 1, std::numeric_limits<int>::max());
+  std::vector<int> right(ymax - ymin + 1, std::numeric_limits<int>::min());
+  auto update_span = [&](int y, int x) {
+    left[y - ymin] = std::min(left[y - ymin], x);
+    right[y - ymin] = std::max(right[y - ymin], x);
+  };
+
+  for (size_t i = 0; i < num_points; ++i) {
+    auto p0 = points[i], p1 = points[(i + 1) % num_points];
+    if (p0.y > p1.y) {
+      std::swap(p0, p1);
+    }
+    // 極端な座標でも溢れないよう，引き算の前に広げる
+    const int64_t dx = static_cast<int64_t>(p1.x) - p0.x;
+    const int64_t dy = static_cast<int64_t>(p1.y) - p0.y;
+    const int y_begin = std::max(p0.y, ymin), y_end = std::min(p1.y, ymax);
+    for (int y = y_begin; y <= y_end; ++y) {
+      if (dy == 0) {
+        update_span(y, p0.x);
+        update_span(y, p1.x);
+      } else {
+        // 結果は p0.x と p1.x の間なので int に収まる
+        update_span(y, static_cast<int>(
+            p0.x + dx * (static_cast<int64_t>(y) - p0.y) / dy));
+      }
+    }
+  }
+
+  for (int y = ymin; y <= ymax; ++y) {
+    const int x0 = std::max(left[y - ymin], 0);
+    const int x1 = std::min(right[y - ymin], writer.Width() - 1);
+    if (x0 <= x1) {
+      FillRectangle(writer, {x0, y}, {x1 - x0 + 1, 1}, c);
+    }
+  }
+}
+
 void DrawDesktop(PixelWriter& writer) {
   const auto width = writer.Width();
   const auto height = writer.Height();
@@ -129,6 +129,24 @@ void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos,
 void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos,
                    const Vector2D<int>& size, const PixelColor& c);
 
+/** @brief 2 点を結ぶ線分を整数演算のみ（Bresenham のアルゴリズム）で描画する。
+ *
+ * 両端点を含む。描画先の範囲外となる点は描画しない。
+ */
+void DrawLine(PixelWriter& writer, Vector2D<int> p0, Vector2D<int> p1,
+              const PixelColor& c);
+
+/** @brief 凸多角形の内部を走査線ごとの水平スパンで塗りつぶす。
+ *
+ * 各走査線について辺との交点の最小・最大の x 座標の間を塗るため，
+ * 凸でない多角形を渡すと各行の外側の交点の間が塗られる。
+ *
+ * @param points  頂点の配列（時計回り・反時計回りどちらでもよい）
+ * @param num_points  頂点数
+ */
+void FillPolygon(PixelWriter& writer, const Vector2D<int>* points,
+                 size_t num_points, const PixelColor& c);
+
 const PixelColor kDesktopBGColor{45, 118, 237};
 const PixelColor kDesktopFGColor{255, 255, 255};
 
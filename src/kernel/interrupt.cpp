@@ -149,7 +149,11 @@ void InitializeInterrupt() {
   set_idt_entry(5,  IntHandlerBR);
   set_idt_entry(6,  IntHandlerUD);
   set_idt_entry(7,  IntHandlerNM);
-  set_idt_entry(8,  IntHandlerDF);
+  SetIDTEntry(idt[8],
+              MakeIDTAttr(DescriptorType::kInterruptGate, 0 /* DPL */,
+                          true /* present */, kISTForDoubleFault /* IST */),
+              reinterpret_cast<uint64_t>(IntHandlerDF),
+              kKernelCS);
   set_idt_entry(10, IntHandlerTS);
   set_idt_entry(11, IntHandlerNP);
   set_idt_entry(12, IntHandlerSS);
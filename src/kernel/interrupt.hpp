@@ -50,6 +50,7 @@ constexpr InterruptDescriptorAttribute MakeIDTAttr(
 }
 
 const int kISTForTimer = 1; // index of the interrupt stack table
+const int kISTForDoubleFault = 2; // IST for #DF, used when a task stack hits its guard page
 
 void SetIDTEntry(InterruptDescriptor& desc,
                  InterruptDescriptorAttribute attr,
@@ -0,0 +1,137 @@
+/**
+ * @file io_ring.cpp
+ *
+ * I/O リングの実装．
+ */
+
+#include "io_ring.hpp"
+
+#include <cstring>
+#include <utility>
+
+#include "task.hpp"
+
+namespace {
+  bool IsPowerOfTwo(uint32_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+  }
+
+  size_t AlignUp(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+  }
+}
+
+IORing::~IORing() {
+  if (num_frames_ > 0) {
+    memory_manager->Free(frame_, num_frames_);
+  }
+}
+
+Error IORing::Initialize(uint32_t sq_entries, uint32_t cq_entries) {
+  if (!IsPowerOfTwo(sq_entries) || sq_entries > kMaxEntries ||
+      !IsPowerOfTwo(cq_entries) || cq_entries > kMaxEntries) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+
+  const size_t sq_offset = AlignUp(sizeof(AppRing), 64);
+  const size_t cq_offset = AlignUp(sq_offset + sizeof(AppRingSQE) * sq_entries, 64);
+  const size_t bytes = cq_offset + sizeof(AppRingCQE) * cq_entries;
+  const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+  auto [ frame, err ] = memory_manager->Allocate(num_frames);
+  if (err) {
+    return err;
+  }
+
+  frame_ = frame;
+  num_frames_ = num_frames;
+  memset(frame_.Frame(), 0, num_frames_ * kBytesPerFrame);
+
+  auto base = reinterpret_cast<uint8_t*>(frame_.Frame());
+  header_ = reinterpret_cast<AppRing*>(base);
+  sqes_ = reinterpret_cast<AppRingSQE*>(base + sq_offset);
+  cqes_ = reinterpret_cast<AppRingCQE*>(base + cq_offset);
+  sq_mask_ = sq_entries - 1;
+  cq_mask_ = cq_entries - 1;
+
+  header_->sq_entries = sq_entries;
+  header_->cq_entries = cq_entries;
+  header_->sq_offset = sq_offset;
+  header_->cq_offset = cq_offset;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+std::optional<AppRingSQE> IORing::PopSubmission() {
+  const uint32_t sq_tail = __atomic_load_n(&header_->sq_tail, __ATOMIC_ACQUIRE);
+  if (sq_head_ == sq_tail) {
+    return std::nullopt;
+  }
+  // 実行中のタイマの分も完了キューの場所を予約済みとして数える
+  if (NumCompletions() + num_timers_ > cq_mask_) {
+    return std::nullopt;
+  }
+
+  // 実行中にアプリが書き換えても影響しないよう，コピーを返す
+  const AppRingSQE sqe = sqes_[sq_head_ & sq_mask_];
+  ++sq_head_;
+  __atomic_store_n(&header_->sq_head, sq_head_, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+void IORing::PostCompletion(uint64_t user_data, uint64_t value, int error) {
+  auto& cqe = cqes_[cq_tail_ & cq_mask_];
+  cqe.user_data = user_data;
+  cqe.value = value;
+  cqe.error = error;
+  ++cq_tail_;
+  __atomic_store_n(&header_->cq_tail, cq_tail_, __ATOMIC_RELEASE);
+}
+
+uint32_t IORing::NumCompletions() const {
+  return cq_tail_ - __atomic_load_n(&header_->cq_head, __ATOMIC_ACQUIRE);
+}
+
+Error IORing::AddTimer(unsigned long timeout, uint64_t user_data) {
+  if (num_timers_ == kMaxTimers) {
+    return MAKE_ERROR(Error::kFull);
+  }
+  timers_[num_timers_++] = PendingTimer{timeout, user_data};
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+int IORing::CompleteTimers(unsigned long tick) {
+  int num_completed = 0;
+  for (int i = 0; i < num_timers_;) {
+    if (timers_[i].timeout > tick) {
+      ++i;
+      continue;
+    }
+    PostCompletion(timers_[i].user_data, timers_[i].timeout, 0);
+    timers_[i] = timers_[--num_timers_];
+    ++num_completed;
+  }
+  return num_completed;
+}
+
+void CompleteRingTimers(uint64_t task_id, unsigned long tick) {
+  auto task = task_manager->FindTask(task_id);
+  if (task == nullptr || !task->Ring()) {
+    // アプリが終了した後に残っていたタイマ
+    return;
+  }
+  if (task->Ring()->CompleteTimers(tick) == 0) {
+    return;
+  }
+  // どのスレッドが RingEnter や Poll でこのリングを待っているか分からないので，すべて起こす
+  task->Wakeup();
+  for (auto id : task->Process()->threads) {
+    if (auto thread = task_manager->FindTask(id)) {
+      thread->Wakeup();
+    }
+  }
+}
+
+void ReleaseIORing(Task& task) {
+  __asm__("cli");
+  auto ring = std::move(task.Ring());
+  __asm__("sti");
+}
@@ -0,0 +1,99 @@
+/**
+ * @file io_ring.hpp
+ *
+ * アプリとカーネルが共有メモリでやりとりする投入・完了キュー（I/O リング）．
+ *
+ * アプリは投入キューに複数の操作を積んでから 1 回のシステムコールで通知する．
+ * カーネルは操作を実行し，結果を完了キューに積む．
+ * タイマのように後で終わる操作は，タイマ割り込みの中で完了キューに積まれる．
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "app_ring.hpp"
+#include "error.hpp"
+#include "memory_manager.hpp"
+
+class Task;
+
+class IORing {
+ public:
+  static const uint32_t kMaxEntries = 4096;
+  static const int kMaxTimers = 64;
+
+  IORing() = default;
+  ~IORing();
+  IORing(const IORing&) = delete;
+  IORing& operator=(const IORing&) = delete;
+
+  /** @brief 各キューの要素数を指定してリングのためのフレームを確保する．
+   *
+   * @param sq_entries  投入キューの要素数．2 のべき乗
+   * @param cq_entries  完了キューの要素数．2 のべき乗
+   */
+  Error Initialize(uint32_t sq_entries, uint32_t cq_entries);
+
+  uintptr_t PhysAddress() const { return reinterpret_cast<uintptr_t>(header_); }
+  size_t NumFrames() const { return num_frames_; }
+  uint32_t CQEntries() const { return cq_mask_ + 1; }
+
+  /** @brief アプリのアドレス空間でこのリングがマップされている仮想アドレス */
+  uint64_t AppAddress() const { return app_addr_; }
+  void SetAppAddress(uint64_t addr) { app_addr_ = addr; }
+
+  /** @brief 投入キューから次の要素を取り出す．
+   *
+   * 完了キューに結果を置く場所がなければ取り出さない．
+   * 取り出した要素は必ず 1 つの完了を生むので，完了キューが溢れることはない．
+   */
+  std::optional<AppRingSQE> PopSubmission();
+
+  /** @brief 完了キューに結果を積む．呼び出し側で割り込みを禁止すること． */
+  void PostCompletion(uint64_t user_data, uint64_t value, int error);
+
+  /** @brief アプリがまだ取り出していない完了の数 */
+  uint32_t NumCompletions() const;
+  /** @brief 取り出し済みでまだ完了していない操作（タイマ）の数 */
+  int NumPending() const { return num_timers_; }
+
+  /** @brief timeout の tick に完了する操作を登録する．呼び出し側で割り込みを禁止すること． */
+  Error AddTimer(unsigned long timeout, uint64_t user_data);
+
+  /** @brief tick までに期限を迎えた操作を完了させ，完了させた数を返す． */
+  int CompleteTimers(unsigned long tick);
+
+ private:
+  struct PendingTimer {
+    unsigned long timeout;
+    uint64_t user_data;
+  };
+
+  FrameID frame_{kNullFrame};
+  size_t num_frames_{0};
+  uint64_t app_addr_{0};
+
+  // アプリが書き換えられない値はカーネル側に控えておき，共有ページの値は信用しない
+  AppRing* header_{nullptr};
+  AppRingSQE* sqes_{nullptr};
+  AppRingCQE* cqes_{nullptr};
+  uint32_t sq_mask_{0}, cq_mask_{0};
+  uint32_t sq_head_{0}, cq_tail_{0};
+
+  // タイマ割り込みの中から触るので，メモリ確保の要らない固定長の配列にする
+  std::array<PendingTimer, kMaxTimers> timers_{};
+  int num_timers_{0};
+};
+
+/** @brief タイマ割り込みから呼ばれ，タスクのリングで期限を迎えた操作を完了させる．
+ *
+ * task_id はリングを持つアプリ本体のタスク．完了させたら，同じアプリのスレッドもすべて起こす．
+ */
+void CompleteRingTimers(uint64_t task_id, unsigned long tick);
+
+/** @brief アプリの終了時にタスクのリングを解放する． */
+void ReleaseIORing(Task& task);
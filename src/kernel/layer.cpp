@@ -1,6 +1,8 @@
 #include "layer.hpp"
 
 #include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include "console.hpp"
 #include "logger.hpp"
 #include "task.hpp"
@@ -86,7 +88,7 @@ void LayerManager::Draw(const Rectangle<int>& area) const {
   for (auto layer : layer_stack_) {
     layer->DrawTo(back_buffer_, area);
   }
-  screen_->Copy(area.pos, back_buffer_, area);
+  CopyToScreen(area);
 }
 
 void LayerManager::Draw(unsigned int id) const {
@@ -110,11 +112,14 @@ void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
       layer->DrawTo(back_buffer_, window_area);
     }
   }
-  screen_->Copy(window_area.pos, back_buffer_, window_area);
+  CopyToScreen(window_area);
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
   auto layer = FindLayer(id);
+  if (MoveByBlit(*layer, new_pos)) {
+    return;
+  }
   const auto window_size = layer->GetWindow()->Size();
   const auto old_pos = layer->GetPosition();
   layer->Move(new_pos);
@@ -124,6 +129,9 @@ void LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
 
 void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
   auto layer = FindLayer(id);
+  if (MoveByBlit(*layer, layer->GetPosition() + pos_diff)) {
+    return;
+  }
   const auto window_size = layer->GetWindow()->Size();
   const auto old_pos = layer->GetPosition();
   layer->MoveRelative(pos_diff);
@@ -164,11 +172,8 @@ void LayerManager::Hide(unsigned int id) {
   }
 }
 
-Layer* LayerManager::FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const {
-  auto pred = [pos, exclude_id](Layer* layer) {
-    if (layer->ID() == exclude_id) {
-      return false;
-    }
+Layer* LayerManager::FindLayerByPosition(Vector2D<int> pos) const {
+  auto pred = [pos](Layer* layer) {
     const auto& win = layer->GetWindow();
     if (!win) {
       return false;
@@ -205,6 +210,93 @@ int LayerManager::GetHeight(unsigned int id) {
   return -1;
 }
 
+void LayerManager::SetCursor(const std::shared_ptr<Window>& cursor) {
+  cursor_ = cursor;
+}
+
+void LayerManager::MoveCursor(Vector2D<int> pos) {
+  if (!cursor_) {
+    return;
+  }
+  const Rectangle<int> old_area{cursor_pos_, cursor_->Size()};
+  cursor_pos_ = pos;
+  // 旧位置の画素を back_buffer_ から復元してから新しい位置に描く
+  screen_->Copy(old_area.pos, back_buffer_, old_area);
+  DrawCursor({cursor_pos_, cursor_->Size()});
+}
+
+bool LayerManager::MoveByBlit(Layer& layer, Vector2D<int> new_pos) {
+  const auto win = layer.GetWindow();
+  if (!win || win->HasTransparentColor() ||
+      layer_stack_.empty() || layer_stack_.back() != &layer) {
+    return false;
+  }
+
+  const auto size = win->Size();
+  const auto old_pos = layer.GetPosition();
+  const auto diff = new_pos - old_pos;
+  const auto screen_size = ScreenSize();
+  auto on_screen = [&screen_size](Vector2D<int> pos, Vector2D<int> size) {
+    return pos.x >= 0 && pos.y >= 0 &&
+           pos.x + size.x <= screen_size.x && pos.y + size.y <= screen_size.y;
+  };
+  // 移動前後で重なりがなければずらす意味がないので通常の再描画に任せる
+  if (!on_screen(old_pos, size) || !on_screen(new_pos, size) ||
+      abs(diff.x) >= size.x || abs(diff.y) >= size.y) {
+    return false;
+  }
+  if (diff.x == 0 && diff.y == 0) {
+    return true;
+  }
+
+  layer.Move(new_pos);
+  back_buffer_.Move(new_pos, {old_pos, size});
+
+  // 旧位置のうち新しい位置に覆われない部分（横方向と縦方向の帯）を重ね合わせ直す
+  Rectangle<int> exposed[2]{};
+  if (diff.y > 0) {
+    exposed[0] = {old_pos, {size.x, diff.y}};
+  } else if (diff.y < 0) {
+    exposed[0] = {{old_pos.x, new_pos.y + size.y}, {size.x, -diff.y}};
+  }
+  const int overlap_y = std::max(old_pos.y, new_pos.y);
+  const int overlap_h = size.y - abs(diff.y);
+  if (diff.x > 0) {
+    exposed[1] = {{old_pos.x, overlap_y}, {diff.x, overlap_h}};
+  } else if (diff.x < 0) {
+    exposed[1] = {{new_pos.x + size.x, overlap_y}, {-diff.x, overlap_h}};
+  }
+  for (const auto& area : exposed) {
+    if (area.size.x <= 0 || area.size.y <= 0) {
+      continue;
+    }
+    for (auto l : layer_stack_) {
+      l->DrawTo(back_buffer_, area);
+    }
+  }
+
+  CopyToScreen({ElementMin(old_pos, new_pos),
+                size + Vector2D<int>{abs(diff.x), abs(diff.y)}});
+  return true;
+}
+
+void LayerManager::CopyToScreen(const Rectangle<int>& area) const {
+  screen_->Copy(area.pos, back_buffer_, area);
+  DrawCursor(area);
+}
+
+void LayerManager::DrawCursor(const Rectangle<int>& area) const {
+  if (!cursor_) {
+    return;
+  }
+  const Rectangle<int> cursor_area{cursor_pos_, cursor_->Size()};
+  const auto intersection = area & cursor_area;
+  if (intersection.size.x <= 0 || intersection.size.y <= 0) {
+    return;
+  }
+  cursor_->DrawTo(*screen_, cursor_pos_, intersection);
+}
+
 namespace {
   FrameBuffer* screen;
 
@@ -225,10 +317,6 @@ LayerManager* layer_manager;
 ActiveLayer::ActiveLayer(LayerManager& manager) : manager_{manager} {
 }
 
-void ActiveLayer::SetMouseLayer(unsigned int mouse_layer) {
-  mouse_layer_ = mouse_layer;
-}
-
 void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer_ == layer_id) {
     return;
@@ -245,8 +333,7 @@ void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer_ > 0) {
     Layer* layer = manager_.FindLayer(active_layer_);
     layer->GetWindow()->Activate();
-    manager_.UpDown(active_layer_, 0);
-    manager_.UpDown(active_layer_, manager_.GetHeight(mouse_layer_) - 1);
+    manager_.UpDown(active_layer_, std::numeric_limits<int>::max());
     manager_.Draw(active_layer_);
     SendWindowActiveMessage(active_layer_, 1);
   }
@@ -88,15 +88,39 @@ class LayerManager {
   void Hide(unsigned int id);
 
   /** @brief 指定された座標にウィンドウを持つ最も上に表示されているレイヤーを探す。 */
-  Layer* FindLayerByPosition(Vector2D<int> pos, unsigned int exclude_id) const;
+  Layer* FindLayerByPosition(Vector2D<int> pos) const;
   /** @brief 指定された ID を持つレイヤーを返す。 */
   Layer* FindLayer(unsigned int id);
   /** @brief 指定されたレイヤーの現在の高さを返す。 */
   int GetHeight(unsigned int id);
 
+  /** @brief マウスカーソルの画像を設定する。表示は MoveCursor で行う。
+   *
+   * カーソルはレイヤーとしては扱わず，重ね合わせの結果を画面へ転送した後に
+   * 画面へ直接描画する（カーソルプレーン）。
+   * カーソルの下の画素は back_buffer_ に重ね合わせ結果として残っているので，
+   * それを退避領域として使い，カーソル移動時はそこから旧位置を復元する。
+   */
+  void SetCursor(const std::shared_ptr<Window>& cursor);
+  /** @brief マウスカーソルを指定位置に移動する。レイヤーの再描画は行わない。 */
+  void MoveCursor(Vector2D<int> pos);
+
  private:
+  /** @brief 最前面の不透明なレイヤーを，重ね合わせ済みの画素をずらすことで移動する。
+   *
+   * 移動によって新たに見えるようになった帯状の領域だけを重ね合わせ直す。
+   * 条件を満たさない場合は何もせず false を返す。
+   */
+  bool MoveByBlit(Layer& layer, Vector2D<int> new_pos);
+  /** @brief back_buffer_ の指定範囲を画面へ転送し，重なるカーソルを描き直す。 */
+  void CopyToScreen(const Rectangle<int>& area) const;
+  /** @brief カーソルが area と重なっていれば画面に描画する。 */
+  void DrawCursor(const Rectangle<int>& area) const;
+
   FrameBuffer* screen_{nullptr};
   mutable FrameBuffer back_buffer_{};
+  std::shared_ptr<Window> cursor_{};
+  Vector2D<int> cursor_pos_{};
   std::vector<std::unique_ptr<Layer>> layers_{};
   std::vector<Layer*> layer_stack_{};
   unsigned int latest_id_{0};
@@ -107,14 +131,12 @@ extern LayerManager* layer_manager;
 class ActiveLayer {
  public:
   ActiveLayer(LayerManager& manager);
-  void SetMouseLayer(unsigned int mouse_layer);
   void Activate(unsigned int layer_id);
   unsigned int GetActive() const { return active_layer_; }
 
  private:
   LayerManager& manager_;
   unsigned int active_layer_{0};
-  unsigned int mouse_layer_{0};
 };
 
 extern ActiveLayer* active_layer;
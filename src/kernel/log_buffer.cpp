@@ -0,0 +1,227 @@
+/**
+ * @file log_buffer.cpp
+ *
+ * カーネルログのリングバッファを実装したファイル．
+ */
+
+#include "log_buffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "console.hpp"
+#include "layer.hpp"
+#include "serial.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+  const size_t kNumLogSlots = 512;
+  const size_t kLogSlotBytes = 120;
+
+  /** @brief ログリングの 1 レコード．
+   *
+   * seq はレコード番号 n を書き込み中なら 2n+1，書き込み済みなら 2n+2 になる．
+   * 読み出し側は読む前後で seq が変わっていないことを確かめる．
+   */
+  struct LogSlot {
+    std::atomic<uint64_t> seq;
+    uint32_t len;
+    char text[kLogSlotBytes];
+  };
+
+  LogSlot log_slots[kNumLogSlots];
+  std::atomic<uint64_t> log_next{0};  // 次に割り当てるレコード番号
+
+  std::atomic_flag log_draining = ATOMIC_FLAG_INIT;
+  uint64_t log_drained = 0;  // log_draining を取ったコンテキストだけが触る
+  std::atomic<bool> log_drain_started{false};
+
+  const int kLogDrainTimer = 1;
+  const unsigned long kLogDrainInterval = kTimerFreq / 20;
+  // アイドルタスクと同じ最低レベル．端末やアプリが動いている間は割り込まない
+  const int kLogDrainTaskLevel = 0;
+
+  void AppendLogRecord(const char* s, size_t len) {
+    const uint64_t n = log_next.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = log_slots[n % kNumLogSlots];
+    slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(slot.text, s, len);
+    slot.len = len;
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+  }
+
+  enum class ReadResult {
+    kOK,
+    kNotReady,  // まだ書き込み中
+    kLost,      // 読む前に上書きされた
+  };
+
+  ReadResult ReadLogRecord(uint64_t n, char* buf, size_t& len) {
+    const auto& slot = log_slots[n % kNumLogSlots];
+    const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq < 2 * n + 2) {
+      return ReadResult::kNotReady;
+    } else if (seq > 2 * n + 2) {
+      return ReadResult::kLost;
+    }
+
+    len = std::min<size_t>(slot.len, kLogSlotBytes);
+    memcpy(buf, slot.text, len);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) {
+      return ReadResult::kLost;
+    }
+    return ReadResult::kOK;
+  }
+
+  /** @brief コンソールのレイヤを画面へ反映する．
+   *
+   * ログ出力タスクからは合成中のメインタスクと競合しないよう，メインタスクに描画を頼む．
+   * タスクが動き出す前は他に描画するものがいないので，その場で描画する．
+   */
+  void DrawConsole() {
+    if (layer_manager == nullptr) {
+      return;
+    }
+    if (!log_drain_started.load(std::memory_order_acquire)) {
+      layer_manager->Draw(console->LayerID());
+      return;
+    }
+    __asm__("cli");
+    Message msg = MakeLayerMessage(
+      task_manager->CurrentTask().ID(), console->LayerID(), LayerOperation::Draw, {});
+    task_manager->SendMessage(1, msg);
+    __asm__("sti");
+  }
+
+  /** @brief コンソールとシリアルへ書き出す文字列を 1 回の描画分だけ貯めるバッファ． */
+  class LogOutput {
+   public:
+    void Write(const char* s, size_t len) {
+      SerialWrite(s, len);
+      while (len > 0) {
+        const size_t n = std::min(len, sizeof(buf_) - 1 - len_);
+        memcpy(&buf_[len_], s, n);
+        len_ += n;
+        s += n;
+        len -= n;
+        if (len_ == sizeof(buf_) - 1) {
+          Flush();
+        }
+      }
+    }
+
+    void Flush() {
+      if (len_ == 0) {
+        return;
+      }
+      buf_[len_] = '\0';
+      console->PutString(buf_);
+      len_ = 0;
+      DrawConsole();
+    }
+
+   private:
+    char buf_[1024];
+    size_t len_ = 0;
+  };
+
+  void TaskLogDrain(uint64_t task_id, int64_t data) {
+    __asm__("cli");
+    Task& task = task_manager->CurrentTask();
+    timer_manager->AddTimer(
+        Timer{timer_manager->CurrentTick() + kLogDrainInterval, kLogDrainTimer, task_id});
+    __asm__("sti");
+
+    while (true) {
+      __asm__("cli");
+      auto msg = task.ReceiveMessage();
+      if (!msg) {
+        task.Sleep();
+        __asm__("sti");
+        continue;
+      }
+      __asm__("sti");
+
+      if (msg->type == Message::kTimerTimeout &&
+          msg->arg.timer.value == kLogDrainTimer) {
+        DrainLog();
+        __asm__("cli");
+        timer_manager->AddTimer(
+            Timer{msg->arg.timer.timeout + kLogDrainInterval, kLogDrainTimer, task_id});
+        __asm__("sti");
+      }
+    }
+  }
+}
+
+void AppendLog(const char* s, size_t len) {
+  while (len > 0) {
+    const size_t n = std::min(len, kLogSlotBytes);
+    AppendLogRecord(s, n);
+    s += n;
+    len -= n;
+  }
+
+  if (!log_drain_started.load(std::memory_order_acquire)) {
+    DrainLog();
+  }
+}
+
+void DrainLog() {
+  if (log_draining.test_and_set(std::memory_order_acquire)) {
+    return;
+  }
+
+  LogOutput out;
+  char text[kLogSlotBytes];
+  uint64_t next;
+  while ((next = log_next.load(std::memory_order_acquire)) != log_drained) {
+    if (next - log_drained > kNumLogSlots) {
+      char s[64];
+      int n = sprintf(s, "[log: %lu messages lost]\n",
+                      next - kNumLogSlots - log_drained);
+      out.Write(s, n);
+      log_drained = next - kNumLogSlots;
+    }
+
+    size_t len;
+    auto result = ReadLogRecord(log_drained, text, len);
+    if (result == ReadResult::kNotReady) {
+      // 書き込み中のコンテキストが終わるのを待つ．続きは次回に出力する．
+      break;
+    }
+    if (result == ReadResult::kOK) {
+      out.Write(text, len);
+    }
+    ++log_drained;
+  }
+  out.Flush();
+
+  log_draining.clear(std::memory_order_release);
+}
+
+void ForEachLog(const std::function<void (const char* s, size_t len)>& f) {
+  const uint64_t next = log_next.load(std::memory_order_acquire);
+  uint64_t n = next > kNumLogSlots ? next - kNumLogSlots : 0;
+  char text[kLogSlotBytes];
+  for (; n < next; ++n) {
+    size_t len;
+    if (ReadLogRecord(n, text, len) == ReadResult::kOK) {
+      f(text, len);
+    }
+  }
+}
+
+void InitializeLogDrain() {
+  auto& task = task_manager->NewTask().InitContext(TaskLogDrain, 0);
+  // ログ出力タスクが動き出す時点で，描画をメインタスクに頼むようにしておく
+  log_drain_started.store(true, std::memory_order_release);
+  __asm__("cli");
+  task_manager->Wakeup(&task, kLogDrainTaskLevel);
+  __asm__("sti");
+}
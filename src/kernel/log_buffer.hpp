@@ -0,0 +1,34 @@
+/**
+ * @file log_buffer.hpp
+ *
+ * カーネルログを貯めておくリングバッファ．
+ *
+ * Log や printk は文字列をリングバッファに追記するだけで，
+ * コンソールへの描画とシリアルポートへの送信は優先度の低いタスクがまとめて行う．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/** @brief ログリングに文字列を追記する．
+ *
+ * ロックを取らないので，割り込みハンドラや例外ハンドラからも呼び出せる．
+ * 長い文字列は複数のレコードに分割して記録する．
+ * ログ排出タスクの起動前は，追記したその場でコンソールとシリアルへ出力する．
+ */
+void AppendLog(const char* s, size_t len);
+
+/** @brief 溜まっているログをコンソールとシリアルへ出力する．
+ *
+ * 他のコンテキストが出力中なら何もせずに戻る．
+ */
+void DrainLog();
+
+/** @brief リングに残っているログを古い順に f へ渡す． */
+void ForEachLog(const std::function<void (const char* s, size_t len)>& f);
+
+/** @brief ログ排出タスクを起動する．InitializeTask の後に呼ぶこと． */
+void InitializeLogDrain();
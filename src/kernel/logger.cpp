@@ -3,14 +3,12 @@
 #include <cstddef>
 #include <cstdio>
 
-#include "console.hpp"
+#include "log_buffer.hpp"
 
 namespace {
   LogLevel log_level = kWarn;
 }
 
-extern Console* console;
-
 void SetLogLevel(LogLevel level) {
   log_level = level;
 }
@@ -28,6 +26,8 @@ int Log(LogLevel level, const char* format, ...) {
   result = vsprintf(s, format, ap);
   va_end(ap);
 
-  console->PutString(s);
+  if (result > 0) {
+    AppendLog(s, result);
+  }
   return result;
 }
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
 
 #include <deque>
 #include <limits>
@@ -37,6 +38,14 @@
 #include "terminal.hpp"
 #include "fat.hpp"
 #include "syscall.hpp"
+#include "log_buffer.hpp"
+#include "serial.hpp"
+#include "block_device.hpp"
+#include "block_cache.hpp"
+#include "virtio_blk.hpp"
+#include "app_cache.hpp"
+#include "sysinfo.hpp"
+#include "stack_pool.hpp"
 
 int printk(const char* format, ...) {
   va_list ap;
@@ -47,7 +56,9 @@ int printk(const char* format, ...) {
   result = vsprintf(s, format, ap);
   va_end(ap);
 
-  console->PutString(s);
+  if (result > 0) {
+    AppendLog(s, result);
+  }
   return result;
 }
 
@@ -116,6 +127,34 @@ void InputTextWindow(char c) {
   layer_manager->Draw(text_window_layer_id);
 }
 
+/** @brief ファイルシステムを置くブロックデバイスを用意し，ボリュームの先頭アドレスを返す．
+ *
+ * ローダがボリュームイメージを読み込んでいればそれを使う．
+ * そうでなければ virtio-blk をバッファキャッシュ経由で必要な部分だけ読み込む．
+ */
+void* InitializeBootVolume(void* volume_image) {
+  if (volume_image) {
+    auto bpb = reinterpret_cast<fat::BPB*>(volume_image);
+    const uint64_t total_sectors =
+      bpb->total_sectors_32 != 0 ? bpb->total_sectors_32 : bpb->total_sectors_16;
+    boot_block_device = new RamBlockDevice{
+      volume_image, total_sectors * bpb->bytes_per_sector / BlockDevice::kSectorSize};
+    return volume_image;
+  }
+
+  auto [dev, err] = virtio::FindBlockDevice();
+  if (err) {
+    Log(kError, "failed to find boot volume: %s\n", err.Name());
+    exit(1);
+  }
+  boot_block_device = dev;
+  if (auto err = InitializeBlockCache(*dev)) {
+    Log(kError, "failed to initialize block cache: %s\n", err.Name());
+    exit(1);
+  }
+  return BlockCacheBase();
+}
+
 alignas(16) uint8_t kernel_main_stack[1024 * 1024];
 
 extern "C" void KernelMainNewStack(
@@ -125,6 +164,7 @@ extern "C" void KernelMainNewStack(
     void* volume_image) {
   MemoryMap memory_map{memory_map_ref};
 
+  InitializeSerial();
   InitializeGraphics(frame_buffer_config_ref);
   InitializeConsole();
 
@@ -133,13 +173,19 @@ extern "C" void KernelMainNewStack(
 
   InitializeSegmentation();
   InitializePaging();
+  if (auto err = MapWriteCombining(
+        reinterpret_cast<uint64_t>(frame_buffer_config_ref.frame_buffer),
+        4 * frame_buffer_config_ref.pixels_per_scan_line
+          * frame_buffer_config_ref.vertical_resolution)) {
+    Log(kWarn, "failed to map frame buffer as write-combining: %s\n", err.Name());
+  }
   InitializeMemoryManager(memory_map);
   InitializeTSS();
   InitializeInterrupt();
 
-  fat::Initialize(volume_image);
-  InitializeFont();
   InitializePCI();
+  fat::Initialize(InitializeBootVolume(volume_image));
+  InitializeFont();
 
   InitializeLayer();
   InitializeMainWindow();
@@ -148,6 +194,7 @@ extern "C" void KernelMainNewStack(
 
   acpi::Initialize(acpi_table);
   InitializeLAPICTimer();
+  InitializeSysInfo();
 
   const int kTextboxCursorTimer = 1;
   const int kTimer05Sec = static_cast<int>(kTimerFreq * 0.5);
@@ -156,15 +203,17 @@ extern "C" void KernelMainNewStack(
 
   InitializeSyscall();
 
+  InitializeStackPool();
   InitializeTask();
   Task& main_task = task_manager->CurrentTask();
-  terminals = new std::map<uint64_t, Terminal*>;
+  InitializeLogDrain();
+  InitializeBlockCacheFlusher();
 
   usb::xhci::Initialize();
   InitializeKeyboard();
   InitializeMouse();
 
-  app_loads = new std::map<fat::DirectoryEntry*, AppLoadInfo>;
+  InitializeAppCache();
   task_manager->NewTask()
     .InitContext(TaskTerminal, 0)
     .Wakeup();
@@ -204,6 +253,8 @@ extern "C" void KernelMainNewStack(
         textbox_cursor_visible = !textbox_cursor_visible;
         DrawTextCursor(textbox_cursor_visible);
         layer_manager->Draw(text_window_layer_id);
+      } else if (msg->arg.timer.value == kTerminalRenderTimer) {
+        Terminal::RenderDeferred();
       }
       break;
     case Message::kKeyPush:
@@ -232,10 +283,8 @@ extern "C" void KernelMainNewStack(
       }
       break;
     case Message::kLayer:
+      // 完了を待つ送信元はいないので返信しない（返すと受け手のキューに溜まり続ける）
       ProcessLayerMessage(*msg);
-      __asm__("cli");
-      task_manager->SendMessage(msg->src_task, Message{Message::kLayerFinish});
-      __asm__("sti");
       break;
     default:
       Log(kError, "Unknown message type: %d\n", msg->type);
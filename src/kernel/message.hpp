@@ -10,11 +10,9 @@ struct Message {
     kTimerTimeout,
     kKeyPush,
     kLayer,
-    kLayerFinish,
     kMouseMove,
     kMouseButton,
     kWindowActive,
-    kPipe,
     kWindowClose,
   } type;
 
@@ -56,11 +54,6 @@ struct Message {
       int activate; // 1: activate, 0: deactivate
     } window_active;
 
-    struct {
-      char data[16];
-      uint8_t len;
-    } pipe;
-
     struct {
       unsigned int layer_id;
     } window_close;
@@ -1,6 +1,5 @@
 #include "mouse.hpp"
 
-#include <limits>
 #include <memory>
 #include "graphics.hpp"
 #include "layer.hpp"
@@ -117,12 +116,9 @@ void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position) {
   }
 }
 
-Mouse::Mouse(unsigned int layer_id) : layer_id_{layer_id} {
-}
-
 void Mouse::SetPosition(Vector2D<int> position) {
   position_ = position;
-  layer_manager->Move(layer_id_, position_);
+  layer_manager->MoveCursor(position_);
 }
 
 void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
@@ -133,14 +129,14 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x, int8_t displacem
 
   const auto posdiff = position_ - oldpos;
 
-  layer_manager->Move(layer_id_, position_);
+  layer_manager->MoveCursor(position_);
 
   unsigned int close_layer_id = 0;
 
   const bool previous_left_pressed = (previous_buttons_ & 0x01);
   const bool left_pressed = (buttons & 0x01);
   if (!previous_left_pressed && left_pressed) {
-    auto layer = layer_manager->FindLayerByPosition(position_, layer_id_);
+    auto layer = layer_manager->FindLayerByPosition(position_);
     if (layer && layer->IsDraggable()) {
       const auto pos_layer = position_ - layer->GetPosition();
       switch (layer->GetWindow()->GetWindowRegion(pos_layer)) {
@@ -182,18 +178,13 @@ void InitializeMouse() {
   mouse_window->SetTransparentColor(kMouseTransparentColor);
   DrawMouseCursor(mouse_window->Writer(), {0, 0});
 
-  auto mouse_layer_id = layer_manager->NewLayer()
-    .SetWindow(mouse_window)
-    .ID();
+  layer_manager->SetCursor(mouse_window);
 
-  auto mouse = std::make_shared<Mouse>(mouse_layer_id);
+  auto mouse = std::make_shared<Mouse>();
   mouse->SetPosition({200, 200});
-  layer_manager->UpDown(mouse->LayerID(), std::numeric_limits<int>::max());
 
   usb::HIDMouseDriver::default_observer =
     [mouse](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
       mouse->OnInterrupt(buttons, displacement_x, displacement_y);
     };
-
-  active_layer->SetMouseLayer(mouse_layer_id);
 }
@@ -2,7 +2,9 @@
 
 #include <cstdint>
 
+static constexpr uint32_t kIA32_PAT   = 0x00000277;
 static constexpr uint32_t kIA32_EFER  = 0xc0000080;
 static constexpr uint32_t kIA32_STAR  = 0xc0000081;
 static constexpr uint32_t kIA32_LSTAR = 0xc0000082;
 static constexpr uint32_t kIA32_FMASK = 0xc0000084;
+static constexpr uint32_t kIA32_KERNEL_GS_BASE = 0xc0000102;
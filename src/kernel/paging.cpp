@@ -1,9 +1,13 @@
 #include "paging.hpp"
 
+#include <algorithm>
 #include <array>
 
+#include "app_sysinfo.hpp"
 #include "asmfunc.h"
+#include "block_cache.hpp"
 #include "memory_manager.hpp"
+#include "msr.hpp"
 #include "task.hpp"
 
 #include "logger.hpp"
@@ -17,6 +21,16 @@ namespace {
   alignas(kPageSize4K) std::array<uint64_t, 512> pdp_table;
   alignas(kPageSize4K)
     std::array<std::array<uint64_t, 512>, kPageDirectoryCount> page_directory;
+  /** @brief MapWriteCombining で 2MiB ページを分割する際に使うページテーブル．
+   * 分割が必要になるのは範囲の先頭と末尾の 2 箇所だけ． */
+  alignas(kPageSize4K)
+    std::array<std::array<uint64_t, 512>, 2> wc_split_page_tables;
+
+  /** @brief PA1 を WC（0x01）とし，それ以外は電源投入時の既定値とした PAT の値．
+   * PA0=WB, PA1=WC, PA2=UC-, PA3=UC, PA4=WB, PA5=WT, PA6=UC-, PA7=UC */
+  const uint64_t kPATValue = 0x0007'0406'0007'0106;
+  /** @brief PA1 を選ぶページテーブルエントリのビット（PWT=1, PCD=0, PAT=0） */
+  const uint64_t kPTEWriteCombining = 0x008;
 }
 
 void SetupIdentityPageTable() {
@@ -40,6 +54,40 @@ void ResetCR3() {
   SetCR3(reinterpret_cast<uint64_t>(&pml4_table[0]));
 }
 
+Error MapWriteCombining(uint64_t phys_addr, size_t bytes) {
+  const uint64_t begin = phys_addr & ~(kPageSize4K - 1);
+  const uint64_t end = (phys_addr + bytes + kPageSize4K - 1) & ~(kPageSize4K - 1);
+  if (end > kPageDirectoryCount * kPageSize1G) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+
+  WriteMSR(kIA32_PAT, kPATValue);
+
+  size_t num_split_tables = 0;
+  for (uint64_t page = begin & ~(kPageSize2M - 1); page < end; page += kPageSize2M) {
+    auto& pde = page_directory[page / kPageSize1G][page % kPageSize1G / kPageSize2M];
+    if (begin <= page && page + kPageSize2M <= end) {
+      pde |= kPTEWriteCombining;
+      continue;
+    }
+
+    // 範囲の境界を含む 2MiB ページは 4KiB ページに分割する
+    auto& pt = wc_split_page_tables[num_split_tables++];
+    for (int i = 0; i < 512; ++i) {
+      const uint64_t addr = page + i * kPageSize4K;
+      pt[i] = addr | 0x003;
+      if (begin <= addr && addr < end) {
+        pt[i] |= kPTEWriteCombining;
+      }
+    }
+    pde = reinterpret_cast<uint64_t>(&pt[0]) | 0x003;
+  }
+
+  __asm__("wbinvd");
+  ResetCR3();
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 namespace {
 WithError<PageMapEntry*> SetNewPageMapIfNotPresent(PageMapEntry& entry) {
   if (entry.bits.present) {
@@ -108,7 +156,7 @@ Error CleanPageMap(PageMapEntry* page_map, int page_map_level, LinearAddress4Lev
       }
     }
 
-    if (entry.bits.writable) {
+    if (entry.bits.writable && !entry.bits.shared) {
       const auto entry_addr = reinterpret_cast<uintptr_t>(entry.Pointer());
       const FrameID map_frame{entry_addr / kBytesPerFrame};
       if (auto err = memory_manager->Free(map_frame, 1)) {
@@ -121,6 +169,34 @@ Error CleanPageMap(PageMapEntry* page_map, int page_map_level, LinearAddress4Lev
   return MAKE_ERROR(Error::kSuccess);
 }
 
+WithError<PageMapEntry*> SetupLeafEntry(PageMapEntry* pml4_table,
+                                        LinearAddress4Level addr) {
+  PageMapEntry* page_map = pml4_table;
+  for (int level = 4; level > 1; --level) {
+    auto& entry = page_map[addr.Part(level)];
+    auto [ child_map, err ] = SetNewPageMapIfNotPresent(entry);
+    if (err) {
+      return { nullptr, err };
+    }
+    entry.bits.user = 1;
+    entry.bits.writable = 1;
+    page_map = child_map;
+  }
+  return { &page_map[addr.Part(1)], MAKE_ERROR(Error::kSuccess) };
+}
+
+PageMapEntry* FindLeafEntry(PageMapEntry* pml4_table, LinearAddress4Level addr) {
+  PageMapEntry* page_map = pml4_table;
+  for (int level = 4; level > 1; --level) {
+    const auto entry = page_map[addr.Part(level)];
+    if (!entry.bits.present) {
+      return nullptr;
+    }
+    page_map = entry.Pointer();
+  }
+  return &page_map[addr.Part(1)];
+}
+
 const FileMapping* FindFileMapping(const std::vector<FileMapping>& fmaps, uint64_t causal_vaddr) {
   for (const FileMapping& m : fmaps) {
     if (m.vaddr_begin <= causal_vaddr && causal_vaddr < m.vaddr_end) {
@@ -143,6 +219,89 @@ Error PreparePageCache(FileDescriptor& fd, const FileMapping& m, uint64_t causal
   return MAKE_ERROR(Error::kSuccess);
 }
 
+const LoadSegment* FindLoadSegment(const AppImage& image, uint64_t causal_vaddr) {
+  for (const LoadSegment& s : image.segments) {
+    if (s.vaddr <= causal_vaddr && causal_vaddr < s.vaddr + s.memsz) {
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+bool HasFileData(const AppImage& image, uint64_t page_begin) {
+  const uint64_t page_end = page_begin + kPageSize4K;
+  return std::any_of(
+      image.segments.begin(), image.segments.end(), [&](const LoadSegment& s) {
+        return s.vaddr < page_end && page_begin < s.vaddr + s.filesz;
+      });
+}
+
+/** @brief イメージのページテーブルに page_vaddr のページが無ければファイルから読み込む．
+ *
+ * @return イメージのページテーブルのエントリ
+ */
+WithError<PageMapEntry*> LoadImagePage(AppImage& image, LinearAddress4Level page_vaddr) {
+  if (auto entry = FindLeafEntry(image.pml4, page_vaddr); entry && entry->bits.present) {
+    return { entry, MAKE_ERROR(Error::kSuccess) };
+  }
+
+  auto [ page, err ] = NewPageMap();
+  if (err) {
+    return { nullptr, err };
+  }
+
+  // 1 ページに複数のセグメントがかかることもある
+  const uint64_t page_begin = page_vaddr.value;
+  const uint64_t page_end = page_begin + kPageSize4K;
+  auto dst = reinterpret_cast<uint8_t*>(page);
+  for (const LoadSegment& s : image.segments) {
+    const uint64_t copy_begin = std::max(page_begin, s.vaddr);
+    const uint64_t copy_end = std::min(page_end, s.vaddr + s.filesz);
+    if (copy_begin < copy_end) {
+      image.file->Load(dst + (copy_begin - page_begin), copy_end - copy_begin,
+                       s.offset + (copy_begin - s.vaddr));
+    }
+  }
+
+  auto [ entry, err_entry ] = SetupLeafEntry(image.pml4, page_vaddr);
+  if (err_entry) {
+    FreePageMap(page);
+    return { nullptr, err_entry };
+  }
+  entry->data = 0;
+  entry->SetPointer(page);
+  entry->bits.present = 1;
+  entry->bits.user = 1;
+  ++image.num_pages;
+  return { entry, MAKE_ERROR(Error::kSuccess) };
+}
+
+/** @brief アプリのイメージのページを読み込んでマップする．
+ *
+ * ファイルの内容を含むページはイメージのページテーブルにも登録し，
+ * 読み出し専用で共有する（書き込まれたら CopyOnePage で複製される）．
+ * .bss だけのページはタスク専用のゼロページとする．
+ */
+Error PrepareImagePage(AppImage& image, uint64_t causal_vaddr) {
+  LinearAddress4Level page_vaddr{causal_vaddr};
+  page_vaddr.parts.offset = 0;
+  if (!HasFileData(image, page_vaddr.value)) {
+    return SetupPageMaps(page_vaddr, 1);
+  }
+
+  auto [ image_entry, err_load ] = LoadImagePage(image, page_vaddr);
+  if (err_load) {
+    return err_load;
+  }
+  auto [ entry, err ] = SetupLeafEntry(reinterpret_cast<PageMapEntry*>(GetCR3()),
+                                       page_vaddr);
+  if (err) {
+    return err;
+  }
+  *entry = *image_entry;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 Error SetPageContent(PageMapEntry* table, int part,
                      LinearAddress4Level addr, PageMapEntry* content) {
   if (part == 1) {
@@ -195,6 +354,131 @@ Error CleanPageMaps(LinearAddress4Level addr) {
   return CleanPageMap(pml4_table, 4, addr);
 }
 
+Error MapSharedPages(LinearAddress4Level addr, uintptr_t phys_addr, size_t num_4kpages,
+                     bool writable) {
+  auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  const auto begin = addr;
+  for (size_t i = 0; i < num_4kpages; ++i) {
+    auto [ entry, err ] = SetupLeafEntry(pml4_table, addr);
+    if (err) {
+      // 所有者がフレームを解放した後にアプリから触れないよう，マップ済みの分を戻す
+      UnmapSharedPages(begin, i);
+      return err;
+    }
+    entry->data = 0;
+    entry->SetPointer(reinterpret_cast<PageMapEntry*>(phys_addr + i * kPageSize4K));
+    entry->bits.present = 1;
+    entry->bits.writable = writable;
+    entry->bits.user = 1;
+    entry->bits.shared = 1;
+    InvalidateTLB(addr.value);
+    addr.value += kPageSize4K;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error UnmapSharedPages(LinearAddress4Level addr, size_t num_4kpages) {
+  auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+  for (size_t i = 0; i < num_4kpages; ++i) {
+    if (auto entry = FindLeafEntry(pml4_table, addr); entry && entry->bits.shared) {
+      entry->data = 0;
+      InvalidateTLB(addr.value);
+    }
+    addr.value += kPageSize4K;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error MapKernelPage(LinearAddress4Level addr, uintptr_t phys_addr) {
+  auto page_map = reinterpret_cast<PageMapEntry*>(&pml4_table[0]);
+  for (int level = 4; level > 1; --level) {
+    auto& entry = page_map[addr.Part(level)];
+    auto [ child_map, err ] = SetNewPageMapIfNotPresent(entry);
+    if (err) {
+      return err;
+    }
+    entry.bits.writable = 1;
+    page_map = child_map;
+  }
+
+  auto& entry = page_map[addr.Part(1)];
+  entry.data = 0;
+  entry.SetPointer(reinterpret_cast<PageMapEntry*>(phys_addr));
+  entry.bits.present = 1;
+  entry.bits.writable = 1;
+  InvalidateTLB(addr.value);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+PageMapEntry* FindKernelPage(LinearAddress4Level addr) {
+  return FindLeafEntry(reinterpret_cast<PageMapEntry*>(&pml4_table[0]), addr);
+}
+
+namespace {
+void ForEachPage(PageMapEntry* page_map, int page_map_level, uint64_t map_base,
+                 uint64_t begin, uint64_t end,
+                 const std::function<void (uint64_t, PageMapEntry&)>& f) {
+  const uint64_t entry_bytes = kPageSize4K << (9 * (page_map_level - 1));
+  for (int i = 0; i < 512; ++i) {
+    const uint64_t addr = map_base + i * entry_bytes;
+    if (addr + entry_bytes <= begin || !page_map[i].bits.present) {
+      continue;
+    } else if (addr >= end) {
+      break;
+    }
+
+    if (page_map_level == 1) {
+      f(addr, page_map[i]);
+    } else if (!page_map[i].bits.huge_page) {
+      ForEachPage(page_map[i].Pointer(), page_map_level - 1, addr, begin, end, f);
+    }
+  }
+}
+} // namespace
+
+void ForEachKernelPage(uint64_t begin, uint64_t end,
+                       const std::function<void (uint64_t addr, PageMapEntry& entry)>& f) {
+  ForEachPage(reinterpret_cast<PageMapEntry*>(&pml4_table[0]), 4, 0, begin, end, f);
+}
+
+Error FreePageMapTree(PageMapEntry* table, int part) {
+  for (int i = 0; i < 512; ++i) {
+    if (!table[i].bits.present) {
+      continue;
+    }
+    if (part > 1) {
+      if (auto err = FreePageMapTree(table[i].Pointer(), part - 1)) {
+        return err;
+      }
+    } else {
+      const auto page_addr = reinterpret_cast<uintptr_t>(table[i].Pointer());
+      if (auto err = memory_manager->Free(FrameID{page_addr / kBytesPerFrame}, 1)) {
+        return err;
+      }
+    }
+  }
+  return FreePageMap(table);
+}
+
+Error PrefetchAppImage(AppImage& image) {
+  for (const LoadSegment& s : image.segments) {
+    if (s.filesz == 0) {
+      continue;
+    }
+    const uint64_t end = s.vaddr + s.filesz;
+    for (uint64_t page = s.vaddr & ~(kPageSize4K - 1); page < end; page += kPageSize4K) {
+      // ページフォールトによる読み込みと重ならないようにする
+      __asm__("cli");
+      auto [ entry, err ] = LoadImagePage(image, LinearAddress4Level{page});
+      __asm__("sti");
+      if (err) {
+        return err;
+      }
+    }
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
   if (part == 1) {
     for (int i = start; i < 512; ++i) {
@@ -220,16 +504,24 @@ Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
     if (auto err = CopyPageMaps(table, src[i].Pointer(), part - 1, 0)) {
       return err;
     }
-    return MAKE_ERROR(Error::kSuccess);
   }
+  return MAKE_ERROR(Error::kSuccess);
 }
 
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr) {
-  auto& task = task_manager->CurrentTask();
   const bool present = (error_code >> 0) & 1;
   const bool rw      = (error_code >> 1) & 1;
   const bool user    = (error_code >> 2) & 1;
-  if (present && rw && user) {
+  if (!present && !user && InBlockCache(causal_addr)) {
+    // タスクの初期化前（ブート中のファイルシステム初期化）にも起きる
+    return HandleBlockCacheFault(causal_addr);
+  }
+
+  auto& task = task_manager->CurrentTask();
+  if (present && (causal_addr & ~(kPageSize4K - 1)) == kAppSysInfoAddr) {
+    // 全アプリで共有する情報ページは書き込みでコピーさせない
+    return MAKE_ERROR(Error::kAlreadyAllocated);
+  } else if (present && rw && user) {
     return CopyOnePage(causal_addr);
   } else if (present) {
     return MAKE_ERROR(Error::kAlreadyAllocated);
@@ -240,5 +532,10 @@ Error HandlePageFault(uint64_t error_code, uint64_t causal_addr) {
   if (auto m = FindFileMapping(task.FileMaps(), causal_addr)) {
     return PreparePageCache(*task.Files()[m->fd], *m, causal_addr);
   }
+  for (auto image : task.Images()) {
+    if (FindLoadSegment(*image, causal_addr)) {
+      return PrepareImagePage(*image, causal_addr);
+    }
+  }
   return MAKE_ERROR(Error::kIndexOutOfRange);
 }
@@ -8,9 +8,12 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 
 #include "error.hpp"
 
+struct AppImage;
+
 /** @brief 静的に確保するページディレクトリの個数
  *
  * この定数は SetupIdentityPageMap で使用される．
@@ -27,6 +30,18 @@ void SetupIdentityPageTable();
 void InitializePaging();
 void ResetCR3();
 
+/** @brief アイデンティティマップのうち指定された物理アドレス範囲を
+ * ライトコンバイン（WC）でマップし直す．
+ *
+ * PAT の PA1 を WC に設定し，範囲内のページに PWT ビットを立てることで PA1 を選ぶ．
+ * 範囲の両端が 2MiB 境界にない場合，その 2MiB ページは 4KiB ページに分割し，
+ * 範囲外の部分は従来通りのキャッシュ設定のまま残す．
+ *
+ * @param phys_addr  範囲の先頭物理アドレス
+ * @param bytes  範囲の大きさ（バイト）
+ */
+Error MapWriteCombining(uint64_t phys_addr, size_t bytes);
+
 union LinearAddress4Level {
   uint64_t value;
 
@@ -74,7 +89,8 @@ union PageMapEntry {
     uint64_t dirty : 1;
     uint64_t huge_page : 1;
     uint64_t global : 1;
-    uint64_t : 3;
+    uint64_t shared : 1; // 他の所有者から借りたフレーム．CleanPageMaps で解放しない
+    uint64_t : 2;
 
     uint64_t addr : 40;
     uint64_t : 12;
@@ -94,4 +110,46 @@ Error FreePageMap(PageMapEntry* table);
 Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages, bool writable = true);
 Error CleanPageMaps(LinearAddress4Level addr);
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start);
+/** @brief table 以下のページテーブルと，そこからマップされているフレームをすべて解放する．
+ *
+ * @param part  table の階層（PML4 なら 4）
+ */
+Error FreePageMapTree(PageMapEntry* table, int part);
+/** @brief アプリのイメージのうちファイルの内容を含むページをすべて読み込んでおく． */
+Error PrefetchAppImage(AppImage& image);
+
+/** @brief 物理的に連続したフレームを現在のアドレス空間のユーザ領域にマップする．
+ *
+ * マップしたページには shared 属性が付き，CleanPageMaps では解放されない．
+ * フレームの解放は所有者の責任で行う．
+ * 途中で失敗したときは，それまでにマップしたページを解除してから返る．
+ *
+ * @param addr  マップ先の仮想アドレス（4KiB 境界）
+ * @param phys_addr  マップするフレームの先頭物理アドレス（4KiB 境界）
+ * @param num_4kpages  マップするページ数
+ * @param writable  アプリから書き込めるようにするか
+ */
+Error MapSharedPages(LinearAddress4Level addr, uintptr_t phys_addr, size_t num_4kpages,
+                     bool writable = true);
+/** @brief MapSharedPages でマップしたページのマッピングを解除する． */
+Error UnmapSharedPages(LinearAddress4Level addr, size_t num_4kpages);
+
+/** @brief 全タスクで共有されるカーネル用のアドレス範囲に 1 ページをマップする．
+ *
+ * 途中のページテーブルはカーネルのページテーブル（pml4_table）の下に作る．
+ * 新しい PML4 エントリを作る場合，それ以降に作られたアプリ用のページテーブルにしか反映されない．
+ *
+ * @param addr  マップ先の仮想アドレス（4KiB 境界）
+ * @param phys_addr  マップするフレームの物理アドレス
+ */
+Error MapKernelPage(LinearAddress4Level addr, uintptr_t phys_addr);
+/** @brief MapKernelPage でマップしたページのエントリを返す．無ければ nullptr． */
+PageMapEntry* FindKernelPage(LinearAddress4Level addr);
+/** @brief [begin, end) でマップされているカーネルのページを昇順に f へ渡す．
+ *
+ * 存在しないページテーブルは読み飛ばすので，疎な範囲でも速い．
+ */
+void ForEachKernelPage(uint64_t begin, uint64_t end,
+                       const std::function<void (uint64_t addr, PageMapEntry& entry)>& f);
+
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr);
@@ -0,0 +1,35 @@
+/**
+ * @file per_cpu.hpp
+ *
+ * CPU ごとのデータ．
+ *
+ * syscall の入口では IA32_KERNEL_GS_BASE にこのデータのアドレスを置き，
+ * SWAPGS で GS から参照する．それ以外のカーネルのコードは直接参照する．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+class Task;
+
+/** @brief CPU ごとのデータ．
+ *
+ * asmfunc.asm の SyscallEntry がオフセットを直接使うので，
+ * メンバの並びを変えるときは PER_CPU_* も合わせて変えること．
+ */
+struct PerCPUData {
+  Task* current_task;      // 0x00 実行中のタスク
+  uint64_t* os_stack_ptr;  // 0x08 実行中のタスクの OS 用スタックポインタの格納先
+  uint64_t user_rsp;       // 0x10 syscall の入口でアプリの RSP を一時的に置く
+};
+
+extern PerCPUData per_cpu_data;
+
+/** @brief 実行中のタスクを返す．
+ *
+ * 読み出しは 1 命令で，切り替わった後に戻ってくれば同じタスクなので割り込みを禁止しなくてよい．
+ */
+inline Task& CurrentTask() {
+  return *per_cpu_data.current_task;
+}
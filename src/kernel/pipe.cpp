@@ -0,0 +1,230 @@
+/**
+ * @file pipe.cpp
+ *
+ * パイプを実装したファイル．
+ */
+
+#include "pipe.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+Pipe::Pipe(size_t capacity) : buf_(capacity) {
+}
+
+size_t Pipe::Read(void* buf, size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+
+  size_t n;
+  while (true) {
+    __asm__("cli");
+    if (!reading_ && (read_pos_ != write_pos_ || write_closed_)) {
+      reading_ = true;
+      n = std::min(len, write_pos_ - read_pos_);
+      __asm__("sti");
+      break;
+    }
+    auto& task = task_manager->CurrentTask();
+    if (task.KillPending()) {
+      CancelWait(task);
+      __asm__("sti");
+      return 0;
+    }
+    AddWaiter(readers_waiting_, task);
+    task.Sleep();
+    __asm__("sti");
+  }
+
+  // 他の読み手は reading_ が下りるまで待ち，書き手は write_pos_ より後ろにしか書かないので，
+  // ここからは割り込みを許可したまま読める
+  auto bufc = reinterpret_cast<char*>(buf);
+  const size_t begin = read_pos_ % buf_.size();
+  const size_t first = std::min(n, buf_.size() - begin);
+  memcpy(bufc, &buf_[begin], first);
+  memcpy(bufc + first, &buf_[0], n - first);
+
+  __asm__("cli");
+  read_pos_ += n;
+  reading_ = false;
+  WakeupWaiters(readers_waiting_);
+  WakeupWaiters(writers_waiting_);
+  __asm__("sti");
+  return n;
+}
+
+size_t Pipe::Write(const void* buf, size_t len) {
+  // 他の書き手と内容が混ざらないよう，書き終えるまで他の書き手を待たせる
+  while (true) {
+    __asm__("cli");
+    if (!writing_) {
+      writing_ = true;
+      __asm__("sti");
+      break;
+    }
+    auto& task = task_manager->CurrentTask();
+    if (task.KillPending()) {
+      CancelWait(task);
+      __asm__("sti");
+      return 0;
+    }
+    AddWaiter(writers_waiting_, task);
+    task.Sleep();
+    __asm__("sti");
+  }
+
+  auto bufc = reinterpret_cast<const char*>(buf);
+  size_t written = 0;
+  while (written < len) {
+    const size_t space = WaitSpace();
+    if (space == 0) {
+      break;
+    }
+
+    const size_t n = std::min(len - written, space);
+    const size_t begin = write_pos_ % buf_.size();
+    const size_t first = std::min(n, buf_.size() - begin);
+    memcpy(&buf_[begin], bufc + written, first);
+    memcpy(&buf_[0], bufc + written + first, n - first);
+    written += n;
+
+    __asm__("cli");
+    write_pos_ += n;
+    WakeupWaiters(readers_waiting_);
+    __asm__("sti");
+  }
+
+  __asm__("cli");
+  writing_ = false;
+  WakeupWaiters(writers_waiting_);
+  __asm__("sti");
+  return written;
+}
+
+void Pipe::CloseRead() {
+  __asm__("cli");
+  read_closed_ = true;
+  WakeupWaiters(writers_waiting_);
+  __asm__("sti");
+}
+
+void Pipe::CloseWrite() {
+  __asm__("cli");
+  write_closed_ = true;
+  WakeupWaiters(readers_waiting_);
+  __asm__("sti");
+}
+
+bool Pipe::PollRead(Task& task) {
+  if (read_pos_ != write_pos_ || write_closed_) {
+    return true;
+  }
+  AddWaiter(readers_waiting_, task);
+  return false;
+}
+
+bool Pipe::PollWrite(Task& task) {
+  if ((!writing_ && write_pos_ - read_pos_ < buf_.size()) || read_closed_) {
+    return true;
+  }
+  AddWaiter(writers_waiting_, task);
+  return false;
+}
+
+void Pipe::CancelWait(Task& task) {
+  for (auto waiters : {&readers_waiting_, &writers_waiting_}) {
+    waiters->erase(std::remove(waiters->begin(), waiters->end(), &task),
+                   waiters->end());
+  }
+}
+
+void Pipe::AddWaiter(std::deque<Task*>& waiters, Task& task) {
+  // Poll で同じパイプの端を複数渡されても 1 度だけ起こせばよい
+  if (std::find(waiters.begin(), waiters.end(), &task) == waiters.end()) {
+    waiters.push_back(&task);
+  }
+}
+
+void Pipe::WakeupWaiters(std::deque<Task*>& waiters) {
+  // 起こされたタスクは条件を調べ直し，まだ待つなら登録し直す
+  for (auto waiter : waiters) {
+    waiter->Wakeup();
+  }
+  waiters.clear();
+}
+
+size_t Pipe::WaitSpace() {
+  while (true) {
+    __asm__("cli");
+    auto& task = task_manager->CurrentTask();
+    if (read_closed_ || task.KillPending()) {
+      CancelWait(task);
+      __asm__("sti");
+      return 0;
+    }
+    const size_t space = buf_.size() - (write_pos_ - read_pos_);
+    if (space > 0) {
+      __asm__("sti");
+      return space;
+    }
+    AddWaiter(writers_waiting_, task);
+    task.Sleep();
+    __asm__("sti");
+  }
+}
+
+PipeDescriptor::PipeDescriptor(std::shared_ptr<Pipe> pipe, End end)
+    : pipe_{std::move(pipe)}, end_{end} {
+}
+
+PipeDescriptor::~PipeDescriptor() {
+  if (end_ == kWriteEnd) {
+    FinishWrite();
+  } else if (!closed_) {
+    pipe_->CloseRead();
+  }
+}
+
+size_t PipeDescriptor::Read(void* buf, size_t len) {
+  if (end_ != kReadEnd) {
+    return 0;
+  }
+  return pipe_->Read(buf, len);
+}
+
+size_t PipeDescriptor::Write(const void* buf, size_t len) {
+  if (end_ != kWriteEnd || closed_) {
+    return 0;
+  }
+  return pipe_->Write(buf, len);
+}
+
+bool PipeDescriptor::PollRead(Task& task) {
+  // 書き込み側から読もうとしても 0 がすぐ返る
+  return end_ != kReadEnd || pipe_->PollRead(task);
+}
+
+bool PipeDescriptor::PollWrite(Task& task) {
+  return end_ != kWriteEnd || closed_ || pipe_->PollWrite(task);
+}
+
+void PipeDescriptor::CancelPoll(Task& task) {
+  pipe_->CancelWait(task);
+}
+
+void PipeDescriptor::FinishWrite() {
+  if (end_ == kWriteEnd && !closed_) {
+    closed_ = true;
+    pipe_->CloseWrite();
+  }
+}
+
+std::pair<std::shared_ptr<PipeDescriptor>, std::shared_ptr<PipeDescriptor>>
+MakePipe(size_t capacity) {
+  auto pipe = std::make_shared<Pipe>(capacity);
+  return {
+    std::make_shared<PipeDescriptor>(pipe, PipeDescriptor::kReadEnd),
+    std::make_shared<PipeDescriptor>(pipe, PipeDescriptor::kWriteEnd),
+  };
+}
@@ -0,0 +1,97 @@
+/**
+ * @file pipe.hpp
+ *
+ * タスク間でバイト列を受け渡すパイプ．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "file.hpp"
+#include "task.hpp"
+
+/** @brief 読み手と書き手が共有するリングバッファ．
+ *
+ * 読み手は空のとき，書き手は満杯のときにスリープし，相手側の操作で起こされる．
+ * スレッドから同時に読み書きしてもよい．読み出しは 1 タスクずつ順に行い，
+ * 1 回の Write で書く内容は他の書き手の内容と混ざらない．
+ */
+class Pipe {
+ public:
+  static const size_t kDefaultCapacity = 64 * 1024;
+
+  explicit Pipe(size_t capacity = kDefaultCapacity);
+
+  /** @brief 最大 len バイトを読み出す．空なら書き込まれるか書き手が閉じるまで待つ．
+   *
+   * @return 読み出したバイト数．書き手が閉じていて空なら 0．
+   *         待っている間に終了を求められても 0．
+   */
+  size_t Read(void* buf, size_t len);
+  /** @brief len バイトすべてを書き込む．満杯なら読み手が読み出すまで待つ．
+   *
+   * @return 書き込んだバイト数．読み手が閉じるか終了を求められると，
+   *         それまでに書けた分だけを返す．
+   */
+  size_t Write(const void* buf, size_t len);
+  void CloseRead();
+  void CloseWrite();
+  /** @brief 読み出せるものがあるかを返す．なければ task を読み手として待たせる．
+   * 割り込み禁止で呼ぶこと． */
+  bool PollRead(Task& task);
+  /** @brief Write がブロックしないかを返す．ブロックするなら task を書き手として待たせる．
+   * 割り込み禁止で呼ぶこと． */
+  bool PollWrite(Task& task);
+  /** @brief task が待っていれば待ちを取り消す．割り込み禁止で呼ぶこと． */
+  void CancelWait(Task& task);
+
+ private:
+  /** @brief task を待ちに加える．割り込み禁止で呼ぶこと． */
+  static void AddWaiter(std::deque<Task*>& waiters, Task& task);
+  /** @brief 待っているタスクをすべて起こす．割り込み禁止で呼ぶこと． */
+  static void WakeupWaiters(std::deque<Task*>& waiters);
+  /** @brief 空きができるまで待ち，空きのバイト数を返す．
+   * 読み手が閉じたか，終了を求められたら 0 を返す． */
+  size_t WaitSpace();
+
+  std::vector<char> buf_;
+  size_t read_pos_{0}, write_pos_{0};  // 単調増加．buf_ の添字は容量で割った余り
+  bool read_closed_{false}, write_closed_{false};
+  bool reading_{false}, writing_{false};  // 読み出し中，書き込み中のタスクがある
+  std::deque<Task*> readers_waiting_{}, writers_waiting_{};
+};
+
+/** @brief パイプの片方の端を表すファイルディスクリプタ．
+ *
+ * 破棄されると自分の側の端を閉じる．
+ */
+class PipeDescriptor : public FileDescriptor {
+ public:
+  enum End { kReadEnd, kWriteEnd };
+
+  PipeDescriptor(std::shared_ptr<Pipe> pipe, End end);
+  ~PipeDescriptor() override;
+  size_t Read(void* buf, size_t len) override;
+  size_t Write(const void* buf, size_t len) override;
+  size_t Size() const override { return 0; }
+  size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
+  bool PollRead(Task& task) override;
+  bool PollWrite(Task& task) override;
+  void CancelPoll(Task& task) override;
+
+  /** @brief 書き込み側を閉じる．読み手は残りを読み終えると 0 を受け取る． */
+  void FinishWrite();
+
+ private:
+  std::shared_ptr<Pipe> pipe_;
+  End end_;
+  bool closed_{false};
+};
+
+/** @brief パイプを作り，読み出し側と書き込み側のディスクリプタを返す． */
+std::pair<std::shared_ptr<PipeDescriptor>, std::shared_ptr<PipeDescriptor>>
+MakePipe(size_t capacity = Pipe::kDefaultCapacity);
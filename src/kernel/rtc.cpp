@@ -0,0 +1,76 @@
+/**
+ * @file rtc.cpp
+ *
+ * CMOS のリアルタイムクロックを読むプログラムを集めたファイル．
+ */
+
+#include "rtc.hpp"
+
+#include <cstdint>
+
+#include "asmfunc.h"
+
+namespace {
+  const uint16_t kCMOSAddress = 0x70;
+  const uint16_t kCMOSData    = 0x71;
+
+  const uint8_t kRegSecond  = 0x00;
+  const uint8_t kRegMinute  = 0x02;
+  const uint8_t kRegHour    = 0x04;
+  const uint8_t kRegDay     = 0x07;
+  const uint8_t kRegMonth   = 0x08;
+  const uint8_t kRegYear    = 0x09;
+  const uint8_t kRegStatusA = 0x0a;
+  const uint8_t kRegStatusB = 0x0b;
+
+  const uint8_t kStatusAUpdating = 0x80;
+  const uint8_t kStatusB24Hour   = 0x02;
+  const uint8_t kStatusBBinary   = 0x04;
+  const uint8_t kHourPM          = 0x80;
+
+  uint8_t ReadCMOS(uint8_t reg) {
+    IoOut8(kCMOSAddress, reg);
+    return IoIn8(kCMOSData);
+  }
+
+  struct RawTime {
+    uint8_t second, minute, hour, day, month, year;
+
+    bool operator==(const RawTime& rhs) const {
+      return second == rhs.second && minute == rhs.minute && hour == rhs.hour &&
+        day == rhs.day && month == rhs.month && year == rhs.year;
+    }
+  };
+
+  RawTime ReadRawTime() {
+    while (ReadCMOS(kRegStatusA) & kStatusAUpdating);
+    return {ReadCMOS(kRegSecond), ReadCMOS(kRegMinute), ReadCMOS(kRegHour),
+            ReadCMOS(kRegDay), ReadCMOS(kRegMonth), ReadCMOS(kRegYear)};
+  }
+
+  int FromBCD(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0f);
+  }
+}
+
+DateTime ReadRTC() {
+  RawTime t = ReadRawTime();
+  for (RawTime prev{}; !(t == prev); ) {
+    prev = t;
+    t = ReadRawTime();
+  }
+
+  const uint8_t status_b = ReadCMOS(kRegStatusB);
+  const bool pm = t.hour & kHourPM;
+  t.hour &= ~kHourPM;
+  auto conv = [status_b](uint8_t v) {
+    return (status_b & kStatusBBinary) ? v : FromBCD(v);
+  };
+
+  int hour = conv(t.hour);
+  if (!(status_b & kStatusB24Hour)) {
+    hour = hour % 12 + (pm ? 12 : 0);
+  }
+  return {2000 + conv(t.year), conv(t.month), conv(t.day),
+          hour, conv(t.minute), conv(t.second)};
+}
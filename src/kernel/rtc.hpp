@@ -0,0 +1,18 @@
+/**
+ * @file rtc.hpp
+ *
+ * CMOS のリアルタイムクロックから現在の日時を読む．
+ */
+
+#pragma once
+
+struct DateTime {
+  int year, month, day;
+  int hour, minute, second;
+};
+
+/** @brief RTC から現在の日時を読む．
+ *
+ * 更新中に読んで値がずれないよう，同じ値が 2 回続けて読めるまで繰り返す．
+ */
+DateTime ReadRTC();
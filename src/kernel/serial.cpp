@@ -0,0 +1,65 @@
+/**
+ * @file serial.cpp
+ *
+ * シリアルポート（COM1）への出力を実装したファイル．
+ */
+
+#include "serial.hpp"
+
+#include <cstdint>
+
+#include "asmfunc.h"
+
+namespace {
+  const uint16_t kCOM1 = 0x3f8;
+  const uint16_t kData         = kCOM1 + 0;
+  const uint16_t kIntEnable    = kCOM1 + 1;
+  const uint16_t kDivisorLow   = kCOM1 + 0;  // DLAB = 1 のとき
+  const uint16_t kDivisorHigh  = kCOM1 + 1;  // DLAB = 1 のとき
+  const uint16_t kFIFOControl  = kCOM1 + 2;
+  const uint16_t kLineControl  = kCOM1 + 3;
+  const uint16_t kModemControl = kCOM1 + 4;
+  const uint16_t kLineStatus   = kCOM1 + 5;
+  const uint16_t kScratch      = kCOM1 + 7;
+
+  const uint8_t kLineStatusTHRE = 0x20;
+  const int kMaxTransmitSpins = 100000;
+
+  bool serial_available = false;
+
+  void SerialPutChar(char c) {
+    for (int i = 0; i < kMaxTransmitSpins; ++i) {
+      if (IoIn8(kLineStatus) & kLineStatusTHRE) {
+        IoOut8(kData, c);
+        return;
+      }
+    }
+    // 送信が進まないなら以降の出力は諦める
+    serial_available = false;
+  }
+}
+
+void InitializeSerial() {
+  IoOut8(kScratch, 0xa5);
+  if (IoIn8(kScratch) != 0xa5) {
+    return;
+  }
+
+  IoOut8(kIntEnable, 0x00);     // 割り込みは使わない
+  IoOut8(kLineControl, 0x80);   // DLAB = 1
+  IoOut8(kDivisorLow, 0x01);    // 115200 / 1 = 115200bps
+  IoOut8(kDivisorHigh, 0x00);
+  IoOut8(kLineControl, 0x03);   // DLAB = 0, 8bit, パリティなし, ストップビット 1
+  IoOut8(kFIFOControl, 0xc7);   // FIFO 有効，送受信 FIFO クリア，閾値 14 バイト
+  IoOut8(kModemControl, 0x0b);  // DTR, RTS, OUT2
+  serial_available = true;
+}
+
+void SerialWrite(const char* s, size_t len) {
+  for (size_t i = 0; i < len && serial_available; ++i) {
+    if (s[i] == '\n') {
+      SerialPutChar('\r');
+    }
+    SerialPutChar(s[i]);
+  }
+}
@@ -0,0 +1,23 @@
+/**
+ * @file serial.hpp
+ *
+ * シリアルポート（COM1）への出力を提供する．
+ */
+
+#pragma once
+
+#include <cstddef>
+
+/** @brief COM1 を 115200bps, 8N1 で初期化する．
+ *
+ * ポートが存在しない場合は以降の SerialWrite を何もしない関数にする．
+ */
+void InitializeSerial();
+
+/** @brief COM1 へ文字列を送信する．
+ *
+ * '\n' は "\r\n" に変換して送信する．
+ * 送信バッファが空くのを待つ処理には上限を設けてあるので，
+ * 受信側が止まっていてもカーネルが停止することはない．
+ */
+void SerialWrite(const char* s, size_t len);
@@ -0,0 +1,109 @@
+/**
+ * @file stack_pool.cpp
+ *
+ * タスクのスタックのプールを実装したファイル．
+ */
+
+#include "stack_pool.hpp"
+
+#include <array>
+#include <cstdlib>
+
+#include "logger.hpp"
+#include "memory_manager.hpp"
+#include "paging.hpp"
+
+namespace {
+  const size_t kPageSize = 4096;
+  /** @brief スタック 1 つ分の仮想アドレスの幅．先頭の 1 ページがガードページ */
+  const size_t kSlotBytes = kPageSize + kTaskStackBytes;
+  const size_t kStackPages = kTaskStackBytes / kPageSize;
+  /** @brief 起動時にマップしておくスタックの数 */
+  const size_t kInitialStacks = 16;
+
+  // タスクの終了処理（割り込み禁止中）から返却されるので，メモリ確保の要らない固定長の配列にする
+  std::array<uint64_t, kMaxTaskStacks> free_stacks;
+  size_t num_free{0};
+  size_t num_stacks{0};
+  size_t num_allocations{0};
+  size_t num_reuses{0};
+
+  /** @brief 割り込みを禁止し，それまでの割り込み許可フラグを返す． */
+  uint64_t SaveAndDisableInterrupt() {
+    uint64_t rflags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags) :: "memory");
+    return rflags;
+  }
+
+  void RestoreInterrupt(uint64_t rflags) {
+    if (rflags & 0x200) {
+      __asm__ volatile("sti" ::: "memory");
+    }
+  }
+
+  /** @brief 新しいスロットにスタックをマップし，その終端を返す．割り込み禁止中に呼ぶこと． */
+  WithError<uint64_t> MapNewStack() {
+    if (num_stacks == kMaxTaskStacks) {
+      return {0, MAKE_ERROR(Error::kFull)};
+    }
+
+    auto [ frame, err ] = memory_manager->Allocate(kStackPages);
+    if (err) {
+      return {0, err};
+    }
+
+    // ガードページはマップしない
+    const uint64_t stack_begin = kTaskStackBase + num_stacks * kSlotBytes + kPageSize;
+    auto buf = reinterpret_cast<uint8_t*>(frame.Frame());
+    for (size_t i = 0; i < kStackPages; ++i) {
+      if (auto err = MapKernelPage(LinearAddress4Level{stack_begin + i * kPageSize},
+                                   reinterpret_cast<uintptr_t>(buf + i * kPageSize))) {
+        memory_manager->Free(frame, kStackPages);
+        return {0, err};
+      }
+    }
+
+    ++num_stacks;
+    return {stack_begin + kTaskStackBytes, MAKE_ERROR(Error::kSuccess)};
+  }
+}
+
+void InitializeStackPool() {
+  for (size_t i = 0; i < kInitialStacks; ++i) {
+    auto [ stack_end, err ] = MapNewStack();
+    if (err) {
+      Log(kError, "failed to map task stack: %s\n", err.Name());
+      exit(1);
+    }
+    free_stacks[num_free++] = stack_end;
+  }
+}
+
+WithError<uint64_t> AllocateTaskStack() {
+  const auto rflags = SaveAndDisableInterrupt();
+  WithError<uint64_t> result{0, MAKE_ERROR(Error::kSuccess)};
+  if (num_free > 0) {
+    result.value = free_stacks[--num_free];
+    ++num_reuses;
+  } else {
+    result = MapNewStack();
+  }
+  if (!result.error) {
+    ++num_allocations;
+  }
+  RestoreInterrupt(rflags);
+  return result;
+}
+
+void FreeTaskStack(uint64_t stack_end) {
+  const auto rflags = SaveAndDisableInterrupt();
+  free_stacks[num_free++] = stack_end;
+  RestoreInterrupt(rflags);
+}
+
+TaskStackStats GetTaskStackStats() {
+  const auto rflags = SaveAndDisableInterrupt();
+  TaskStackStats stats{num_stacks, num_free, num_allocations, num_reuses};
+  RestoreInterrupt(rflags);
+  return stats;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file stack_pool.hpp
+ *
+ * タスクのカーネルスタックを払い出すプール．
+ *
+ * スタックは kTaskStackBase から始まる仮想アドレス範囲に並べ，
+ * それぞれの下に何もマップしないガードページを置く．
+ * スタックが溢れるとガードページでフォルトし，ダブルフォルトとして報告される．
+ * 終了したタスクのスタックはマップしたまま返却し，次のタスクで使い回す．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
+
+/** @brief タスクのスタックを置く先頭仮想アドレス（PML4 の 3 番目のエントリ） */
+const uint64_t kTaskStackBase = 0x0000'0180'0000'0000;
+/** @brief 1 つのタスクのスタックの大きさ */
+const size_t kTaskStackBytes = 8 * 4096;
+/** @brief 同時に存在できるスタックの最大数 */
+const size_t kMaxTaskStacks = 4096;
+
+/** @brief スタックのプールを初期化し，起動直後に必要な数のスタックをマップしておく．
+ *
+ * アプリ用のページテーブルを作る前（全タスクで共有される PML4 エントリを作る前），
+ * かつ InitializeTask より前に呼ぶこと．
+ */
+void InitializeStackPool();
+
+/** @brief スタックを 1 つ確保し，その終端（最上位の次）のアドレスを返す．
+ *
+ * 返却済みのスタックがあればそれを使う．中身は 0 クリアしない．
+ */
+WithError<uint64_t> AllocateTaskStack();
+
+/** @brief AllocateTaskStack で確保したスタックを返却する．割り込み禁止中に呼んでもよい． */
+void FreeTaskStack(uint64_t stack_end);
+
+struct TaskStackStats {
+  size_t num_stacks;       // これまでにマップしたスタックの数
+  size_t num_free;         // 返却されて使われていないスタックの数
+  size_t num_allocations;  // AllocateTaskStack が成功した回数
+  size_t num_reuses;       // そのうち返却済みのスタックを使い回した回数
+};
+
+TaskStackStats GetTaskStackStats();
@@ -1,9 +1,11 @@
 #include "syscall.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cerrno>
-#include <cmath>
+#include <optional>
+#include <vector>
 #include <fcntl.h>
 
 #include "asmfunc.h"
@@ -15,6 +17,14 @@
 #include "timer.hpp"
 #include "keyboard.hpp"
 #include "app_event.hpp"
+#include "app_draw.hpp"
+#include "app_poll.hpp"
+#include "paging.hpp"
+#include "memory_manager.hpp"
+#include "block_cache.hpp"
+#include "io_ring.hpp"
+#include "futex.hpp"
+#include "thread.hpp"
 
 namespace syscall {
   struct Result {
@@ -22,6 +32,12 @@ namespace syscall {
     int error;
   };
 
+namespace {
+  bool IsUserBuffer(uint64_t addr, size_t bytes) {
+    return addr >= 0x8000'0000'0000'0000 && addr + bytes >= addr;
+  }
+}
+
 #define SYSCALL(name) \
   Result name( \
       uint64_t arg1, uint64_t arg2, uint64_t arg3, \
@@ -44,13 +60,11 @@ SYSCALL(PutString) {
   const auto fd = arg1;
   const char* s = reinterpret_cast<const char*>(arg2);
   const auto len = arg3;
-  if (len > 1024) {
-    return { 0, E2BIG };
+  if (!IsUserBuffer(arg2, len)) {
+    return { 0, EFAULT };
   }
 
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
 
   if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
     return {0, EBADF};
@@ -59,31 +73,74 @@ SYSCALL(PutString) {
 }
 
 SYSCALL(Exit) {
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
   return { task.OSStackPointer(), static_cast<int>(arg1) };
 }
 
+namespace {
+  unsigned int AddAppWindow(const std::shared_ptr<ToplevelWindow>& win,
+                            int x, int y) {
+    __asm__("cli");
+    const auto layer_id = layer_manager->NewLayer()
+      .SetWindow(win)
+      .SetDraggable(true)
+      .Move({x, y})
+      .ID();
+    active_layer->Activate(layer_id);
+
+    const auto task_id = CurrentTask().ID();
+    layer_task_map->insert(std::make_pair(layer_id, task_id));
+    __asm__("sti");
+    return layer_id;
+  }
+}
+
 SYSCALL(OpenWindow) {
   const int w = arg1, h = arg2, x = arg3, y = arg4;
   const auto title = reinterpret_cast<const char*>(arg5);
   const auto win = std::make_shared<ToplevelWindow>(
       w, h, screen_config.pixel_format, title);
 
-  __asm__("cli");
-  const auto layer_id = layer_manager->NewLayer()
-    .SetWindow(win)
-    .SetDraggable(true)
-    .Move({x, y})
-    .ID();
-  active_layer->Activate(layer_id);
-
-  const auto task_id = task_manager->CurrentTask().ID();
-  layer_task_map->insert(std::make_pair(layer_id, task_id));
-  __asm__("sti");
+  return { AddAppWindow(win, x, y), 0 };
+}
+
+SYSCALL(OpenWindowSurface) {
+  const int w = arg1, h = arg2, x = arg3, y = arg4;
+  const auto title = reinterpret_cast<const char*>(arg5);
+  const auto app_surface = reinterpret_cast<AppWindowSurface*>(arg6);
+  if (!IsUserBuffer(arg6, sizeof(AppWindowSurface))) {
+    return { 0, EFAULT };
+  }
+  if (w <= ToplevelWindow::kMarginX || h <= ToplevelWindow::kMarginY) {
+    return { 0, EINVAL };
+  }
 
-  return { layer_id, 0 };
+  const auto win = std::make_shared<ToplevelWindow>(
+      w, h, screen_config.pixel_format, title);
+  const auto inner_size = win->InnerSize();
+  auto surface = std::make_unique<WindowSurface>();
+  if (auto err = surface->Initialize(inner_size.x, inner_size.y)) {
+    return { 0, ENOMEM };
+  }
+
+  auto& task = CurrentTask();
+
+  // ファイルマップ領域と同様に，スタックの下から順に割り当てる
+  const uint64_t vaddr_begin =
+    task.ReserveFileMap(surface->NumFrames() * kBytesPerFrame);
+  const auto phys_addr = reinterpret_cast<uintptr_t>(surface->Pixels());
+  if (auto err = MapSharedPages(LinearAddress4Level{vaddr_begin},
+                                phys_addr, surface->NumFrames())) {
+    return { 0, ENOMEM };
+  }
+  surface->SetAppAddress(vaddr_begin);
+
+  app_surface->pixels = reinterpret_cast<uint32_t*>(vaddr_begin);
+  app_surface->width = inner_size.x;
+  app_surface->height = inner_size.y;
+
+  win->AttachSurface(std::move(surface), ToplevelWindow::kTopLeftMargin);
+  return { AddAppWindow(win, x, y), 0 };
 }
 
 namespace {
@@ -143,62 +200,234 @@ SYSCALL(WinRedraw) {
       }, arg1);
 }
 
+SYSCALL(WinCommit) {
+  const uint32_t layer_flags = arg1 >> 32;
+  const unsigned int layer_id = arg1 & 0xffffffff;
+  const int x = arg2, y = arg3, w = arg4, h = arg5;
+
+  __asm__("cli");
+  auto layer = layer_manager->FindLayer(layer_id);
+  __asm__("sti");
+  if (layer == nullptr) {
+    return { 0, EBADF };
+  }
+  auto win = layer->GetWindow();
+  if (win->Surface() == nullptr) {
+    return { 0, EINVAL };
+  }
+
+  const auto area = win->CommitSurface({{x, y}, {w, h}});
+  if ((layer_flags & 1) == 0 && area.size.x > 0 && area.size.y > 0) {
+    __asm__("cli");
+    layer_manager->Draw(layer_id, area);
+    __asm__("sti");
+  }
+  return { 0, 0 };
+}
+
 SYSCALL(WinDrawLine) {
   return DoWinFunc(
       [](Window& win,
          int x0, int y0, int x1, int y1, uint32_t color) {
-        auto sign = [](int x) {
-          return (x > 0) ? 1 : (x < 0) ? -1 : 0;
-        };
-        const int dx = x1 - x0 + sign(x1 - x0);
-        const int dy = y1 - y0 + sign(y1 - y0);
-
-        if (dx == 0 && dy == 0) {
-          win.Writer()->Write({x0, y0}, ToColor(color));
-          return Result{ 0, 0 };
+        DrawLine(*win.Writer(), {x0, y0}, {x1, y1}, ToColor(color));
+        return Result{ 0, 0 };
+      }, arg1, arg2, arg3, arg4, arg5, arg6);
+}
+
+namespace {
+  // 1 回のシステムコールで受け付ける線分・頂点の最大数
+  const size_t kMaxDrawElements = 4096;
+}
+
+SYSCALL(WinDrawLines) {
+  const auto lines = reinterpret_cast<const AppLine*>(arg2);
+  const size_t num_lines = arg3;
+  if (num_lines > kMaxDrawElements) {
+    return { 0, E2BIG };
+  }
+  if (!IsUserBuffer(arg2, sizeof(AppLine) * num_lines)) {
+    return { 0, EFAULT };
+  }
+
+  return DoWinFunc(
+      [](Window& win, const AppLine* lines, size_t num_lines) {
+        auto writer = win.Writer();
+        for (size_t i = 0; i < num_lines; ++i) {
+          const auto& l = lines[i];
+          DrawLine(*writer, {l.x0, l.y0}, {l.x1, l.y1}, ToColor(l.color));
         }
+        return Result{ num_lines, 0 };
+      }, arg1, lines, num_lines);
+}
 
-        const auto floord = static_cast<double(*)(double)>(floor);
-        const auto ceild = static_cast<double(*)(double)>(ceil);
+SYSCALL(WinDrawPolyline) {
+  const auto points = reinterpret_cast<const AppPoint*>(arg2);
+  const size_t num_points = arg3;
+  if (num_points > kMaxDrawElements) {
+    return { 0, E2BIG };
+  }
+  if (!IsUserBuffer(arg2, sizeof(AppPoint) * num_points)) {
+    return { 0, EFAULT };
+  }
 
-        if (abs(dx) >= abs(dy)) {
-          if (dx < 0) {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-          }
-          const auto roundish = y1 >= y0 ? floord : ceild;
-          const double m = static_cast<double>(dy) / dx;
-          for (int x = x0; x <= x1; ++x) {
-            const int y = roundish(m * (x - x0) + y0);
-            win.Writer()->Write({x, y}, ToColor(color));
-          }
-        } else {
-          if (dy < 0) {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-          }
-          const auto roundish = x1 >= x0 ? floord : ceild;
-          const double m = static_cast<double>(dx) / dy;
-          for (int y = y0; y <= y1; ++y) {
-            const int x = roundish(m * (y - y0) + x0);
-            win.Writer()->Write({x, y}, ToColor(color));
+  return DoWinFunc(
+      [](Window& win,
+         const AppPoint* points, size_t num_points, uint32_t color) {
+        auto writer = win.Writer();
+        const auto c = ToColor(color);
+        if (num_points == 1) {
+          DrawLine(*writer, {points[0].x, points[0].y},
+                   {points[0].x, points[0].y}, c);
+        }
+        for (size_t i = 1; i < num_points; ++i) {
+          DrawLine(*writer, {points[i - 1].x, points[i - 1].y},
+                   {points[i].x, points[i].y}, c);
+        }
+        return Result{ num_points, 0 };
+      }, arg1, points, num_points, arg4);
+}
+
+SYSCALL(WinFillPolygon) {
+  const auto points = reinterpret_cast<const AppPoint*>(arg2);
+  const size_t num_points = arg3;
+  if (num_points > kMaxDrawElements) {
+    return { 0, E2BIG };
+  }
+  if (!IsUserBuffer(arg2, sizeof(AppPoint) * num_points)) {
+    return { 0, EFAULT };
+  }
+
+  return DoWinFunc(
+      [](Window& win,
+         const AppPoint* points, size_t num_points, uint32_t color) {
+        std::vector<Vector2D<int>> vertices(num_points);
+        for (size_t i = 0; i < num_points; ++i) {
+          vertices[i] = {points[i].x, points[i].y};
+        }
+        FillPolygon(*win.Writer(), vertices.data(), num_points,
+                    ToColor(color));
+        return Result{ num_points, 0 };
+      }, arg1, points, num_points, arg4);
+}
+
+namespace {
+  // kWriteString で受け付ける文字列の最大長
+  const size_t kMaxDrawStringLen = 1024;
+
+  Rectangle<int> ClipToWindow(const Window& win, int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) {
+      return {{0, 0}, {0, 0}};
+    }
+    return Rectangle<int>{{x, y}, {w, h}} & Rectangle<int>{{0, 0}, win.Size()};
+  }
+
+  int ExecuteDrawCommand(Window& win, const AppDrawCommand& cmd) {
+    auto writer = win.Writer();
+    const auto c = ToColor(cmd.color);
+
+    switch (cmd.type) {
+    case AppDrawCommand::kFillRectangle: {
+      const auto& a = cmd.arg.rect;
+      const auto r = ClipToWindow(win, a.x, a.y, a.w, a.h);
+      FillRectangle(*writer, r.pos, r.size, c);
+      return 0;
+    }
+    case AppDrawCommand::kDrawLine: {
+      const auto& a = cmd.arg.line;
+      DrawLine(*writer, {a.x0, a.y0}, {a.x1, a.y1}, c);
+      return 0;
+    }
+    case AppDrawCommand::kWriteString: {
+      const auto& a = cmd.arg.text;
+      const auto s_addr = reinterpret_cast<uint64_t>(a.s);
+      if (!IsUserBuffer(s_addr, 1)) {
+        return EFAULT;
+      }
+      const size_t len = strnlen(a.s, kMaxDrawStringLen);
+      if (len == kMaxDrawStringLen) {
+        return E2BIG;
+      }
+      // 1 バイトあたり 8 ピクセル以下なので，バイト数で判定すれば必ず収まる
+      if (a.x < 0 || a.y < 0 ||
+          a.x + 8 * static_cast<int>(len) > win.Width() ||
+          a.y + 16 > win.Height()) {
+        return EINVAL;
+      }
+      WriteString(*writer, {a.x, a.y}, a.s, c);
+      return 0;
+    }
+    case AppDrawCommand::kBlit: {
+      const auto& a = cmd.arg.blit;
+      if (a.w <= 0 || a.h <= 0) {
+        return 0;
+      }
+      const auto p_addr = reinterpret_cast<uint64_t>(a.pixels);
+      // int 同士の積で溢れないよう，先に size_t へ広げる
+      if (!IsUserBuffer(p_addr, sizeof(uint32_t) * static_cast<size_t>(a.w) *
+                                static_cast<size_t>(a.h))) {
+        return EFAULT;
+      }
+      const auto r = ClipToWindow(win, a.x, a.y, a.w, a.h);
+      for (int y = r.pos.y; y < r.pos.y + r.size.y; ++y) {
+        const int64_t offset = (static_cast<int64_t>(y) - a.y) * a.w +
+                               (static_cast<int64_t>(r.pos.x) - a.x);
+        win.WriteLine({r.pos.x, y}, &a.pixels[offset], r.size.x);
+      }
+      return 0;
+    }
+    default:
+      return EINVAL;
+    }
+  }
+}
+
+SYSCALL(WinDrawCommands) {
+  const auto cmds = reinterpret_cast<const AppDrawCommand*>(arg2);
+  const size_t num_cmds = arg3;
+  if (num_cmds > kAppMaxDrawCommands) {
+    return { 0, E2BIG };
+  }
+  if (!IsUserBuffer(arg2, sizeof(AppDrawCommand) * num_cmds)) {
+    return { 0, EFAULT };
+  }
+
+  return DoWinFunc(
+      [](Window& win, const AppDrawCommand* cmds, size_t num_cmds) {
+        for (size_t i = 0; i < num_cmds; ++i) {
+          if (int err = ExecuteDrawCommand(win, cmds[i])) {
+            return Result{ i, err };
           }
         }
-        return Result{ 0, 0 };
-      }, arg1, arg2, arg3, arg4, arg5, arg6);
+        return Result{ num_cmds, 0 };
+      }, arg1, cmds, num_cmds);
 }
 
 SYSCALL(CloseWindow) {
   const unsigned int layer_id = arg1 & 0xffffffff;
+
+  // 他のアプリのウィンドウを閉じると，その描画面を使用中のまま解放してしまう
+  __asm__("cli");
   const auto layer = layer_manager->FindLayer(layer_id);
+  const auto task_it = layer_task_map->find(layer_id);
+  Task* const owner = task_it == layer_task_map->end() ?
+    nullptr : task_manager->FindTask(task_it->second);
+  const bool owned =
+    owner != nullptr && owner->Process() == CurrentTask().Process();
+  __asm__("sti");
 
-  if (layer == nullptr) {
-    return { EBADF, 0 };
+  if (layer == nullptr || !owned) {
+    return { 0, EBADF };
   }
 
   const auto layer_pos = layer->GetPosition();
   const auto win_size = layer->GetWindow()->Size();
 
+  // 描画面のフレームはウィンドウとともに解放されるので，先にマップを外す
+  if (auto surface = layer->GetWindow()->Surface()) {
+    UnmapSharedPages(LinearAddress4Level{surface->AppAddress()},
+                     surface->NumFrames());
+  }
+
   __asm__("cli");
   active_layer->Activate(0);
   layer_manager->RemoveLayer(layer_id);
@@ -209,6 +438,23 @@ SYSCALL(CloseWindow) {
   return { 0, 0 };
 }
 
+namespace {
+  /** @brief ReadEvent でアプリに渡すメッセージかを返す． */
+  bool IsAppEvent(const Message& msg) {
+    switch (msg.type) {
+    case Message::kKeyPush:
+    case Message::kMouseMove:
+    case Message::kMouseButton:
+    case Message::kWindowClose:
+      return true;
+    case Message::kTimerTimeout:
+      return msg.arg.timer.value < 0;
+    default:
+      return false;
+    }
+  }
+}
+
 SYSCALL(ReadEvent) {
   if (arg1 < 0x8000'0000'0000'0000) {
     return { 0, EFAULT };
@@ -216,15 +462,21 @@ SYSCALL(ReadEvent) {
   const auto app_events = reinterpret_cast<AppEvent*>(arg1);
   const size_t len = arg2;
 
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
   size_t i = 0;
 
+  // イベント待ちで眠る前に，溜まっている端末出力などを反映しておく
+  for (auto& fd : task.Files()) {
+    if (fd) {
+      fd->Flush();
+    }
+  }
+
   while (i < len) {
     __asm__("cli");
-    auto msg = task.ReceiveMessage();
-    if (!msg && i == 0) {
+    // アプリ向けでないメッセージ（端末のタイマなど）は持ち主のために残す
+    auto msg = task.ReceiveMessageIf(IsAppEvent);
+    if (!msg && i == 0 && !task.KillPending()) {
       task.Sleep();
       continue;
     }
@@ -267,12 +519,10 @@ SYSCALL(ReadEvent) {
       ++i;
       break;
     case Message::kTimerTimeout:
-      if (msg->arg.timer.value < 0) {
-        app_events[i].type = AppEvent::kTimerTimeout;
-        app_events[i].arg.timer.timeout = msg->arg.timer.timeout;
-        app_events[i].arg.timer.value = -msg->arg.timer.value;
-        ++i;
-      }
+      app_events[i].type = AppEvent::kTimerTimeout;
+      app_events[i].arg.timer.timeout = msg->arg.timer.timeout;
+      app_events[i].arg.timer.value = -msg->arg.timer.value;
+      ++i;
       break;
     case Message::kWindowClose:
       app_events[i].type = AppEvent::kQuit;
@@ -293,9 +543,7 @@ SYSCALL(CreateTimer) {
     return { 0, EINVAL };
   }
 
-  __asm__("cli");
-  const uint64_t task_id = task_manager->CurrentTask().ID();
-  __asm__("sti");
+  const uint64_t task_id = CurrentTask().ID();
 
   unsigned long timeout = arg3 * kTimerFreq / 1000;
   if (mode & 1) { // relative
@@ -334,9 +582,7 @@ namespace {
 SYSCALL(OpenFile) {
   const char* path = reinterpret_cast<const char*>(arg1);
   const int flags = arg2;
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
 
   if (strcmp(path, "@stdin") == 0) {
     return {0, 0};
@@ -365,9 +611,7 @@ SYSCALL(ReadFile) {
   const int fd = arg1;
   void* buf = reinterpret_cast<void*>(arg2);
   size_t count = arg3;
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
 
   if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
     return {0, EBADF};
@@ -377,41 +621,407 @@ SYSCALL(ReadFile) {
 
 SYSCALL(DemandPages) {
   const size_t num_pages = arg1;
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
 
+  // スレッドから同時に呼ばれても重ならないようにする
+  __asm__("cli");
   const uint64_t dp_end = task.DPagingEnd();
   task.SetDPagingEnd(dp_end + 4096 * num_pages);
+  __asm__("sti");
   return {dp_end, 0};
 }
 
 SYSCALL(MapFile) {
   const int fd = arg1;
   size_t* file_size = reinterpret_cast<size_t*>(arg2);
-  __asm__("cli");
-  auto& task = task_manager->CurrentTask();
-  __asm__("sti");
+  auto& task = CurrentTask();
 
   if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
     return {0, EBADF};
   }
 
   *file_size = task.Files()[fd]->Size();
-  const uint64_t vaddr_end = task.FileMapEnd();
-  const uint64_t vaddr_begin = (vaddr_end - *file_size) & 0xffff'ffff'ffff'f000;
-  task.SetFileMapEnd(vaddr_begin);
-  task.FileMaps().push_back(FileMapping{fd, vaddr_begin, vaddr_end});
+  const uint64_t bytes = (*file_size + 4095) & 0xffff'ffff'ffff'f000;
+  const uint64_t vaddr_begin = task.ReserveFileMap(bytes);
+  // 他のスレッドのページフォールト処理が参照しているかもしれない
+  __asm__("cli");
+  task.FileMaps().push_back(FileMapping{fd, vaddr_begin, vaddr_begin + bytes});
+  __asm__("sti");
   return {vaddr_begin, 0};
 }
 
+SYSCALL(Fsync) {
+  const int fd = arg1;
+  auto& task = CurrentTask();
+
+  if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
+    return {0, EBADF};
+  }
+  // バッファキャッシュはファイル単位で汚れを管理していないので，全体を書き戻す
+  if (auto [ stats, err ] = FlushBlockCache(); err) {
+    return {0, EIO};
+  }
+  return {0, 0};
+}
+
+SYSCALL(Nop) {
+  return { 0, 0 };
+}
+
+SYSCALL(RingSetup) {
+  if (arg1 > IORing::kMaxEntries || arg2 > IORing::kMaxEntries) {
+    return { 0, EINVAL };
+  }
+  auto& task = CurrentTask();
+  if (task.Ring()) {
+    return { 0, EBUSY };
+  }
+
+  auto ring = std::make_unique<IORing>();
+  if (auto err = ring->Initialize(arg1, arg2)) {
+    return { 0, err.Cause() == Error::kIndexOutOfRange ? EINVAL : ENOMEM };
+  }
+
+  // ファイルマップ領域と同様に，スタックの下から順に割り当てる
+  const uint64_t vaddr_begin = task.ReserveFileMap(ring->NumFrames() * kBytesPerFrame);
+  if (auto err = MapSharedPages(LinearAddress4Level{vaddr_begin},
+                                ring->PhysAddress(), ring->NumFrames())) {
+    return { 0, ENOMEM };
+  }
+  ring->SetAppAddress(vaddr_begin);
+
+  __asm__("cli");
+  if (task.Ring()) {
+    // 他のスレッドが先に作っていた
+    __asm__("sti");
+    UnmapSharedPages(LinearAddress4Level{vaddr_begin}, ring->NumFrames());
+    return { 0, EBUSY };
+  }
+  task.Ring() = std::move(ring);
+  __asm__("sti");
+  return { vaddr_begin, 0 };
+}
+
+namespace {
+  /** @brief リングに投入された操作を 1 つ実行する．
+   *
+   * 後で完了する操作なら std::nullopt を返す．
+   * 描画した後の再描画はまとめて行うため，対象のレイヤを redraw_layers に加える．
+   */
+  std::optional<Result> ExecuteRingOp(Task& task, const AppRingSQE& sqe,
+                                      std::vector<unsigned int>& redraw_layers) {
+    switch (sqe.opcode) {
+    case AppRingSQE::kNop:
+      return Result{ 0, 0 };
+    case AppRingSQE::kOpen:
+      if (!IsUserBuffer(sqe.addr, 1)) {
+        return Result{ 0, EFAULT };
+      }
+      return OpenFile(sqe.addr, sqe.arg, 0, 0, 0, 0);
+    case AppRingSQE::kRead:
+      if (!IsUserBuffer(sqe.addr, sqe.len)) {
+        return Result{ 0, EFAULT };
+      }
+      return ReadFile(sqe.fd, sqe.addr, sqe.len, 0, 0, 0);
+    case AppRingSQE::kWrite:
+      return PutString(sqe.fd, sqe.addr, sqe.len, 0, 0, 0);
+    case AppRingSQE::kDraw: {
+      const uint32_t layer_flags = sqe.arg >> 32;
+      const unsigned int layer_id = sqe.arg & 0xffffffff;
+      const auto res = WinDrawCommands(sqe.arg | (1ull << 32) /* no redraw */,
+                                       sqe.addr, sqe.len, 0, 0, 0);
+      if (res.value > 0 && (layer_flags & 1) == 0 &&
+          std::find(redraw_layers.begin(), redraw_layers.end(), layer_id)
+            == redraw_layers.end()) {
+        redraw_layers.push_back(layer_id);
+      }
+      return res;
+    }
+    case AppRingSQE::kTimer: {
+      const unsigned long timeout =
+        timer_manager->CurrentTick() + sqe.arg * kTimerFreq / 1000;
+      __asm__("cli");
+      auto err = task.Ring()->AddTimer(timeout, sqe.user_data);
+      if (!err) {
+        // リングはスレッドで共有するので，投入したスレッドが先に終了しても完了できるよう
+        // アプリ本体のタスクに対して登録する
+        timer_manager->AddTimer(
+            Timer{timeout, kRingTimerValue, task.Process()->owner_id});
+      }
+      __asm__("sti");
+      if (err) {
+        return Result{ 0, EAGAIN };
+      }
+      return std::nullopt;
+    }
+    default:
+      return Result{ 0, EINVAL };
+    }
+  }
+}
+
+SYSCALL(RingEnter) {
+  const uint32_t min_complete = arg1;
+  auto& task = CurrentTask();
+  auto& ring = task.Ring();
+  if (!ring) {
+    return { 0, EBADF };
+  }
+  if (min_complete > ring->CQEntries()) {
+    return { 0, EINVAL };
+  }
+
+  std::vector<unsigned int> redraw_layers;
+  size_t num_submitted = 0;
+  while (auto sqe = ring->PopSubmission()) {
+    ++num_submitted;
+    if (auto res = ExecuteRingOp(task, *sqe, redraw_layers)) {
+      __asm__("cli");
+      ring->PostCompletion(sqe->user_data, res->value, res->error);
+      __asm__("sti");
+    }
+  }
+
+  for (auto layer_id : redraw_layers) {
+    __asm__("cli");
+    layer_manager->Draw(layer_id);
+    __asm__("sti");
+  }
+
+  // まだ完了していない操作がなくなれば，それ以上は待っても完了が増えない．
+  // min_complete に届かなくてもそこで戻る
+  auto done = [&ring, min_complete]() {
+    return ring->NumCompletions() >= min_complete || ring->NumPending() == 0;
+  };
+  if (!done()) {
+    // 完了待ちで眠る前に，溜まっている端末出力などを反映しておく
+    for (auto& fd : task.Files()) {
+      if (fd) {
+        fd->Flush();
+      }
+    }
+  }
+  while (true) {
+    __asm__("cli");
+    if (done() || task.KillPending()) {
+      break;
+    }
+    task.Sleep();
+  }
+  __asm__("sti");
+
+  return { num_submitted, 0 };
+}
+
+namespace {
+  // 1 回の Poll で待てる対象の最大数
+  const size_t kMaxPollFds = 256;
+
+  /** @brief 待つ対象 1 つの状態を調べる．割り込み禁止で呼ぶこと． */
+  short PollOne(Task& task, const AppPollFd& pfd) {
+    short revents = 0;
+    if (pfd.fd == kAppPollEvents) {
+      if ((pfd.events & kAppPollIn) && task.HasMessage(IsAppEvent)) {
+        revents |= kAppPollIn;
+      }
+      return revents;
+    }
+    if (pfd.fd == kAppPollRing) {
+      if (!task.Ring()) {
+        return kAppPollNval;
+      }
+      if ((pfd.events & kAppPollIn) && task.Ring()->NumCompletions() > 0) {
+        revents |= kAppPollIn;
+      }
+      return revents;
+    }
+
+    if (pfd.fd < 0 || task.Files().size() <= pfd.fd || !task.Files()[pfd.fd]) {
+      return kAppPollNval;
+    }
+    auto& file = *task.Files()[pfd.fd];
+    if ((pfd.events & kAppPollIn) && file.PollRead(task)) {
+      revents |= kAppPollIn;
+    }
+    if ((pfd.events & kAppPollOut) && file.PollWrite(task)) {
+      revents |= kAppPollOut;
+    }
+    return revents;
+  }
+}
+
+SYSCALL(Poll) {
+  const size_t nfds = arg2;
+  const int timeout_ms = arg3; // 負なら無期限に待つ
+  if (nfds > kMaxPollFds) {
+    return { 0, EINVAL };
+  }
+  if (!IsUserBuffer(arg1, sizeof(AppPollFd) * nfds)) {
+    return { 0, EFAULT };
+  }
+  const auto app_fds = reinterpret_cast<AppPollFd*>(arg1);
+  std::vector<AppPollFd> fds(app_fds, app_fds + nfds);
+
+  auto& task = CurrentTask();
+  for (auto& fd : task.Files()) {
+    if (fd) {
+      fd->Flush();
+    }
+  }
+
+  unsigned long deadline = 0;
+  if (timeout_ms > 0) {
+    deadline = timer_manager->CurrentTick() +
+      (static_cast<unsigned long>(timeout_ms) * kTimerFreq + 999) / 1000;
+    __asm__("cli");
+    timer_manager->AddTimer(Timer{deadline, kWakeupTimerValue, task.ID()});
+    __asm__("sti");
+  }
+
+  size_t num_ready;
+  while (true) {
+    __asm__("cli");
+    num_ready = 0;
+    for (auto& pfd : fds) {
+      pfd.revents = PollOne(task, pfd);
+      if (pfd.revents) {
+        ++num_ready;
+      }
+    }
+    if (num_ready > 0 || timeout_ms == 0 || task.KillPending() ||
+        (timeout_ms > 0 && timer_manager->CurrentTick() >= deadline)) {
+      break;
+    }
+    task.Sleep();
+  }
+
+  // 起こしてもらうための登録が残っていると，終了したタスクを起こそうとしかねない
+  for (auto& pfd : fds) {
+    if (0 <= pfd.fd && pfd.fd < task.Files().size() && task.Files()[pfd.fd]) {
+      task.Files()[pfd.fd]->CancelPoll(task);
+    }
+  }
+  __asm__("sti");
+
+  for (size_t i = 0; i < nfds; ++i) {
+    app_fds[i].revents = fds[i].revents;
+  }
+  return { num_ready, 0 };
+}
+
+SYSCALL(ThreadCreate) {
+  const uint64_t entry = arg1;
+  if (!IsUserBuffer(entry, 1)) {
+    return { 0, EFAULT };
+  }
+  auto [ thread_id, err ] = CreateAppThread(CurrentTask(), entry, arg2);
+  if (err) {
+    return { 0, ENOMEM };
+  }
+  return { thread_id, 0 };
+}
+
+SYSCALL(ThreadJoin) {
+  auto [ exit_code, err ] = JoinAppThread(CurrentTask(), arg1);
+  if (err.Cause() == Error::kInterrupted) {
+    return { 0, EINTR };
+  } else if (err) {
+    return { 0, ESRCH };
+  }
+  return { static_cast<uint64_t>(exit_code), 0 };
+}
+
+SYSCALL(FutexWait) {
+  const auto addr = reinterpret_cast<const uint32_t*>(arg1);
+  const uint32_t expected = arg2;
+  const int timeout_ms = arg3; // 負なら無期限に待つ
+  if (!IsUserBuffer(arg1, sizeof(uint32_t)) || arg1 % sizeof(uint32_t) != 0) {
+    return { 0, EFAULT };
+  }
+
+  unsigned long deadline = 0;
+  if (timeout_ms >= 0) {
+    deadline = timer_manager->CurrentTick() +
+      (static_cast<unsigned long>(timeout_ms) * kTimerFreq + 999) / 1000;
+  }
+
+  auto err = FutexWait(CurrentTask(), addr, expected, deadline);
+  switch (err.Cause()) {
+  case Error::kSuccess: return { 0, 0 };
+  case Error::kValueChanged: return { 0, EAGAIN };
+  case Error::kTimedOut: return { 0, ETIMEDOUT };
+  case Error::kInterrupted: return { 0, EINTR };
+  default: return { 0, EINVAL };
+  }
+}
+
+SYSCALL(FutexWake) {
+  const auto addr = reinterpret_cast<const uint32_t*>(arg1);
+  const size_t num = arg2;
+  if (!IsUserBuffer(arg1, sizeof(uint32_t)) || arg1 % sizeof(uint32_t) != 0) {
+    return { 0, EFAULT };
+  }
+  return { FutexWake(CurrentTask(), addr, num), 0 };
+}
+
+SYSCALL(ThreadSelf) {
+  return { CurrentTask().ID(), 0 };
+}
+
+SYSCALL(IsTerminal) {
+  const int fd = arg1;
+  auto& task = CurrentTask();
+
+  if (fd < 0 || task.Files().size() <= fd || !task.Files()[fd]) {
+    return {0, EBADF};
+  }
+  return { task.Files()[fd]->IsTerminal() ? 1u : 0u, 0 };
+}
+
+SYSCALL(RemoveFile) {
+  const char* path = reinterpret_cast<const char*>(arg1);
+
+  switch (fat::RemoveFile(path).Cause()) {
+  case Error::kSuccess: return { 0, 0 };
+  case Error::kNoSuchEntry: return { 0, ENOENT };
+  case Error::kDirectoryNotEmpty: return { 0, ENOTEMPTY };
+  default: return { 0, EIO };
+  }
+}
+
+SYSCALL(MakeDirectory) {
+  const char* path = reinterpret_cast<const char*>(arg1);
+
+  // CreateDirectory は同名のエントリを確かめないので，ここで重複を防ぐ
+  if (fat::FindFile(path).first != nullptr) {
+    return { 0, EEXIST };
+  }
+  auto [dir, err] = fat::CreateDirectory(path);
+  switch (err.Cause()) {
+  case Error::kSuccess: return { 0, 0 };
+  case Error::kIsDirectory: return { 0, EEXIST };
+  case Error::kNoSuchEntry: return { 0, ENOENT };
+  case Error::kNoEnoughMemory: return { 0, ENOSPC };
+  default: return { 0, EIO };
+  }
+}
+
 #undef SYSCALL
 
 } // namespace syscall
 
+/** @brief 実行中のタスクが終了を求められていれば，アプリを呼び出した時の OS 用スタックを返す．
+ *
+ * SyscallEntry がアプリへ戻る直前に呼ぶ．0 以外が返ればアプリへ戻らずに ExitApp する．
+ */
+extern "C" uint64_t PendingKillStackPointer() {
+  auto& task = CurrentTask();
+  return task.KillPending() ? task.OSStackPointer() : 0;
+}
+
 using SyscallFuncType = syscall::Result (uint64_t, uint64_t, uint64_t,
                                          uint64_t, uint64_t, uint64_t);
-extern "C" std::array<SyscallFuncType*, 0x10> syscall_table{
+extern "C" std::array<SyscallFuncType*, 0x23> syscall_table{
   /* 0x00 */ syscall::LogString,
   /* 0x01 */ syscall::PutString,
   /* 0x02 */ syscall::Exit,
@@ -428,6 +1038,25 @@ extern "C" std::array<SyscallFuncType*, 0x10> syscall_table{
   /* 0x0d */ syscall::ReadFile,
   /* 0x0e */ syscall::DemandPages,
   /* 0x0f */ syscall::MapFile,
+  /* 0x10 */ syscall::WinDrawLines,
+  /* 0x11 */ syscall::WinDrawPolyline,
+  /* 0x12 */ syscall::WinFillPolygon,
+  /* 0x13 */ syscall::OpenWindowSurface,
+  /* 0x14 */ syscall::WinCommit,
+  /* 0x15 */ syscall::WinDrawCommands,
+  /* 0x16 */ syscall::Fsync,
+  /* 0x17 */ syscall::Nop,
+  /* 0x18 */ syscall::RingSetup,
+  /* 0x19 */ syscall::RingEnter,
+  /* 0x1a */ syscall::Poll,
+  /* 0x1b */ syscall::ThreadCreate,
+  /* 0x1c */ syscall::ThreadJoin,
+  /* 0x1d */ syscall::FutexWait,
+  /* 0x1e */ syscall::FutexWake,
+  /* 0x1f */ syscall::ThreadSelf,
+  /* 0x20 */ syscall::IsTerminal,
+  /* 0x21 */ syscall::RemoveFile,
+  /* 0x22 */ syscall::MakeDirectory,
 };
 
 void InitializeSyscall() {
@@ -435,5 +1064,7 @@ void InitializeSyscall() {
   WriteMSR(kIA32_LSTAR, reinterpret_cast<uint64_t>(SyscallEntry));
   WriteMSR(kIA32_STAR, static_cast<uint64_t>(8) << 32 |
                        static_cast<uint64_t>(16 | 3) << 48);
-  WriteMSR(kIA32_FMASK, 0);
+  // SyscallEntry が OS 用スタックへ移るまでは割り込みを禁止する
+  WriteMSR(kIA32_FMASK, 0x200u /* IF */);
+  WriteMSR(kIA32_KERNEL_GS_BASE, reinterpret_cast<uint64_t>(&per_cpu_data));
 }
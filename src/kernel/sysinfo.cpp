@@ -0,0 +1,62 @@
+/**
+ * @file sysinfo.cpp
+ *
+ * アプリに見せるシステム情報のページを実装したファイル．
+ */
+
+#include "sysinfo.hpp"
+
+#include <cstring>
+
+#include "graphics.hpp"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+#include "paging.hpp"
+#include "rtc.hpp"
+#include "timer.hpp"
+
+namespace {
+  /** @brief 1970-01-01 から数えた日数を返す． */
+  int64_t DaysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yoe = year - era * 400;
+    const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+  }
+}
+
+AppSysInfo* app_sysinfo = nullptr;
+
+void InitializeSysInfo() {
+  auto [frame, err] = memory_manager->Allocate(1);
+  if (err) {
+    Log(kError, "failed to allocate sysinfo page: %s\n", err.Name());
+    return;
+  }
+
+  auto info = reinterpret_cast<AppSysInfo*>(frame.Frame());
+  memset(info, 0, kBytesPerFrame);
+
+  const auto t = ReadRTC();
+  info->tsc_base = __builtin_ia32_rdtsc();
+  info->realtime_base =
+    DaysFromCivil(t.year, t.month, t.day) * 86400 + t.hour * 3600 + t.minute * 60 + t.second;
+  info->tsc_freq = tsc_freq;
+  info->timer_freq = kTimerFreq;
+  info->tick = timer_manager->CurrentTick();
+  const auto screen_size = ScreenSize();
+  info->screen_width = screen_size.x;
+  info->screen_height = screen_size.y;
+
+  app_sysinfo = info;
+}
+
+Error MapSysInfo() {
+  if (app_sysinfo == nullptr) {
+    return MAKE_ERROR(Error::kSuccess);
+  }
+  return MapSharedPages(LinearAddress4Level{kAppSysInfoAddr},
+                        reinterpret_cast<uintptr_t>(app_sysinfo), 1, false);
+}
@@ -0,0 +1,30 @@
+/**
+ * @file sysinfo.hpp
+ *
+ * アプリに読み出し専用で見せるシステム情報のページ．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "app_sysinfo.hpp"
+#include "error.hpp"
+
+extern AppSysInfo* app_sysinfo;
+
+/** @brief システム情報のページを確保し，起動時に決まる値を書き込む．
+ *
+ * タイマとグラフィックスの初期化より後に呼ぶ．
+ */
+void InitializeSysInfo();
+
+/** @brief 現在のアプリの空間の kAppSysInfoAddr にシステム情報のページをマップする． */
+Error MapSysInfo();
+
+/** @brief タイマ割り込みから呼び，tick を更新する． */
+inline void UpdateSysInfoTick(unsigned long tick) {
+  if (app_sysinfo) {
+    app_sysinfo->tick = tick;
+  }
+}
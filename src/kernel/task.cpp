@@ -1,7 +1,11 @@
 #include "task.hpp"
 
+#include <cstdlib>
+
 #include "asmfunc.h"
+#include "logger.hpp"
 #include "segment.hpp"
+#include "stack_pool.hpp"
 #include "timer.hpp"
 
 namespace {
@@ -16,13 +20,29 @@ namespace {
   }
 } // namespace
 
-Task::Task(uint64_t id) : id_{id}, msgs_{} {
+Task::Task(uint64_t id)
+    : id_{id}, msgs_{}, process_{std::make_shared<AppProcess>()} {
+  process_->owner_id = id;
+}
+
+Task::~Task() {
+  // Finish から呼ばれたときはまだこのスタックの上で動いているが，
+  // Finish は割り込み禁止のまま次のタスクへ切り替えるので，その前に他のタスクに渡ることはない
+  if (stack_end_ != 0) {
+    FreeTaskStack(stack_end_);
+  }
 }
 
 Task& Task::InitContext(TaskFunc* f, int64_t data) {
-  const size_t stack_size = kDefaultStackBytes / sizeof(stack_[0]);
-  stack_.resize(stack_size);
-  uint64_t stack_end = reinterpret_cast<uint64_t>(&stack_[stack_size]);
+  if (stack_end_ == 0) {
+    auto [ stack_end, err ] = AllocateTaskStack();
+    if (err) {
+      Log(kError, "failed to allocate task stack: %s\n", err.Name());
+      exit(1);
+    }
+    stack_end_ = stack_end;
+  }
+  const uint64_t stack_end = stack_end_;
 
   memset(&context_, 0, sizeof(context_));
   context_.cr3 = GetCR3();
@@ -79,35 +99,55 @@ std::optional<Message> Task::ReceiveMessage() {
 }
 
 std::vector<std::shared_ptr<::FileDescriptor>>& Task::Files() {
-  return files_;
+  return process_->files;
 }
 
 uint64_t Task::DPagingBegin() const {
-  return dpaging_begin_;
+  return process_->dpaging_begin;
 }
 
 void Task::SetDPagingBegin(uint64_t v) {
-  dpaging_begin_ = v;
+  process_->dpaging_begin = v;
 }
 
 uint64_t Task::DPagingEnd() const {
-  return dpaging_end_;
+  return process_->dpaging_end;
 }
 
 void Task::SetDPagingEnd(uint64_t v) {
-  dpaging_end_ = v;
+  process_->dpaging_end = v;
 }
 
 uint64_t Task::FileMapEnd() const {
-  return file_map_end_;
+  return process_->file_map_end;
 }
 
 void Task::SetFileMapEnd(uint64_t v) {
-  file_map_end_ = v;
+  process_->file_map_end = v;
+}
+
+uint64_t Task::ReserveFileMap(uint64_t bytes) {
+  __asm__("cli");
+  const uint64_t begin = (process_->file_map_end - bytes) & 0xffff'ffff'ffff'f000;
+  process_->file_map_end = begin;
+  __asm__("sti");
+  return begin;
 }
 
 std::vector<FileMapping>& Task::FileMaps() {
-  return file_maps_;
+  return process_->file_maps;
+}
+
+std::vector<AppImage*>& Task::Images() {
+  return process_->images;
+}
+
+std::unique_ptr<IORing>& Task::Ring() {
+  return process_->ring;
+}
+
+std::shared_ptr<AppProcess>& Task::Process() {
+  return process_;
 }
 
 TaskManager::TaskManager() {
@@ -121,6 +161,8 @@ TaskManager::TaskManager() {
     .SetLevel(0)
     .SetRunning(true);
   running_[0].push_back(&idle);
+
+  UpdatePerCPU();
 }
 
 Task& TaskManager::NewTask() {
@@ -196,13 +238,12 @@ Error TaskManager::Wakeup(uint64_t id, int level) {
 }
 
 Error TaskManager::SendMessage(uint64_t id, const Message& msg) {
-  auto it = std::find_if(tasks_.begin(), tasks_.end(),
-                         [id](const auto& t){ return t->ID() == id; });
-  if (it == tasks_.end()) {
+  auto task = FindTask(id);
+  if (task == nullptr) {
     return MAKE_ERROR(Error::kNoSuchTask);
   }
 
-  (*it)->SendMessage(msg);
+  task->SendMessage(msg);
   return MAKE_ERROR(Error::kSuccess);
 }
 
@@ -210,6 +251,44 @@ Task& TaskManager::CurrentTask() {
   return *running_[current_level_].front();
 }
 
+Task* TaskManager::FindTask(uint64_t id) {
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [id](const auto& t){ return t->ID() == id; });
+  if (it == tasks_.end()) {
+    return nullptr;
+  }
+  return it->get();
+}
+
+Error TaskManager::Kill(uint64_t id, int exit_code) {
+  auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                         [id](const auto& t){ return t->ID() == id; });
+  if (it == tasks_.end()) {
+    return MAKE_ERROR(Error::kNoSuchTask);
+  }
+
+  Task* task = it->get();
+  if (task->Running()) {
+    Erase(running_[task->Level()], task);
+  }
+  for (auto w = finish_waiter_.begin(); w != finish_waiter_.end();) {
+    if (w->second == task) {
+      w = finish_waiter_.erase(w);
+    } else {
+      ++w;
+    }
+  }
+  tasks_.erase(it);
+
+  finish_tasks_[id] = exit_code;
+  if (auto w = finish_waiter_.find(id); w != finish_waiter_.end()) {
+    auto waiter = w->second;
+    finish_waiter_.erase(w);
+    Wakeup(waiter);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 void TaskManager::Finish(int exit_code) {
   Task* current_task = RotateCurrentRunQueue(true);
 
@@ -238,12 +317,29 @@ WithError<int> TaskManager::WaitFinish(uint64_t task_id) {
       finish_tasks_.erase(it);
       break;
     }
+    if (current_task->KillPending()) {
+      if (auto it = finish_waiter_.find(task_id);
+          it != finish_waiter_.end() && it->second == current_task) {
+        finish_waiter_.erase(it);
+      }
+      return {0, MAKE_ERROR(Error::kInterrupted)};
+    }
     finish_waiter_[task_id] = current_task;
     Sleep(current_task);
   }
   return {exit_code, MAKE_ERROR(Error::kSuccess)};
 }
 
+std::optional<int> TaskManager::PollFinish(uint64_t task_id) {
+  auto it = finish_tasks_.find(task_id);
+  if (it == finish_tasks_.end()) {
+    return std::nullopt;
+  }
+  const int exit_code = it->second;
+  finish_tasks_.erase(it);
+  return exit_code;
+}
+
 void TaskManager::ChangeLevelRunning(Task* task, int level) {
   if (level < 0 || level == task->Level()) {
     return;
@@ -293,10 +389,18 @@ Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
     }
   }
 
+  UpdatePerCPU();
   return current_task;
 }
 
+void TaskManager::UpdatePerCPU() {
+  Task& task = CurrentTask();
+  per_cpu_data.current_task = &task;
+  per_cpu_data.os_stack_ptr = &task.OSStackPointer();
+}
+
 TaskManager* task_manager;
+PerCPUData per_cpu_data;
 
 void InitializeTask() {
   task_manager = new TaskManager;
@@ -306,8 +410,3 @@ void InitializeTask() {
       Timer{timer_manager->CurrentTick() + kTaskTimerPeriod, kTaskTimerValue, 1});
   __asm__("sti");
 }
-
-__attribute__((no_caller_saved_registers))
-extern "C" uint64_t GetCurrentTaskOSStackPointer() {
-  return task_manager->CurrentTask().OSStackPointer();
-}
@@ -6,11 +6,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <map>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -18,6 +20,8 @@
 #include "message.hpp"
 #include "paging.hpp"
 #include "fat.hpp"
+#include "io_ring.hpp"
+#include "per_cpu.hpp"
 
 struct TaskContext {
   uint64_t cr3, rip, rflags, reserved1; // offset 0x00
@@ -36,12 +40,53 @@ struct FileMapping {
   uint64_t vaddr_begin, vaddr_end;
 };
 
+/** @brief ELF の PT_LOAD セグメントのうち，ページフォールト時に読み込む範囲 */
+struct LoadSegment {
+  uint64_t vaddr, memsz; // [vaddr, vaddr + memsz) がセグメント全体
+  uint64_t offset, filesz; // ファイル上の位置と大きさ．filesz 以降は .bss
+};
+
+/** @brief 要求時ページングで読み込むアプリのイメージ */
+struct AppImage {
+  std::shared_ptr<::FileDescriptor> file;
+  std::vector<LoadSegment> segments;
+  /** @brief 読み込み済みのページを保持するページテーブル．
+   * 同じアプリを次に起動したタスクはここからページを共有する． */
+  PageMapEntry* pml4;
+  size_t num_pages{0}; // pml4 に読み込んだページ数
+  int num_users{0}; // このイメージを使って実行中のタスク数
+};
+
+/** @brief アプリのスレッドが共有する資源。
+ *
+ * アプリ以外のタスクもそれぞれ 1 つ持つ。
+ * ThreadCreate で作ったスレッドは作ったタスクと同じものを指す。
+ */
+struct AppProcess {
+  /** @brief この AppProcess を作ったタスク（アプリ本体）の ID。スレッドより長く生きる */
+  uint64_t owner_id{0};
+  std::vector<std::shared_ptr<::FileDescriptor>> files{};
+  uint64_t dpaging_begin{0}, dpaging_end{0};
+  uint64_t file_map_end{0};
+  std::vector<FileMapping> file_maps{};
+  std::vector<AppImage*> images{};
+  std::unique_ptr<IORing> ring{};
+  /** @brief アプリ本体のタスク以外に実行中のスレッドのタスク ID */
+  std::vector<uint64_t> threads{};
+  /** @brief 実行中のスレッドのタスク ID から，そのアプリ用スタックの先頭アドレスへの対応 */
+  std::map<uint64_t, uint64_t> thread_stacks{};
+  /** @brief Join されたスレッドのスタック．マップしたまま次のスレッドで使い回す */
+  std::vector<uint64_t> free_thread_stacks{};
+  /** @brief アプリ本体が終了し，スレッドを終了させている途中。新しいスレッドは作らない */
+  bool exiting{false};
+};
+
 class Task {
  public:
   static const int kDefaultLevel = 1;
-  static const size_t kDefaultStackBytes = 8 * 4096;
 
   Task(uint64_t id);
+  ~Task();
   Task& InitContext(TaskFunc* f, int64_t data);
   TaskContext& Context();
   uint64_t& OSStackPointer();
@@ -50,6 +95,22 @@ class Task {
   Task& Wakeup();
   void SendMessage(const Message& msg);
   std::optional<Message> ReceiveMessage();
+  /** @brief pred を満たす最初のメッセージを取り出す。満たさないメッセージは順番どおり残す。 */
+  template <class Pred>
+  std::optional<Message> ReceiveMessageIf(Pred pred) {
+    auto it = std::find_if(msgs_.begin(), msgs_.end(), pred);
+    if (it == msgs_.end()) {
+      return std::nullopt;
+    }
+    auto m = *it;
+    msgs_.erase(it);
+    return m;
+  }
+  /** @brief pred を満たすメッセージが届いているかを返す。取り出しはしない。 */
+  template <class Pred>
+  bool HasMessage(Pred pred) const {
+    return std::any_of(msgs_.begin(), msgs_.end(), pred);
+  }
   std::vector<std::shared_ptr<::FileDescriptor>>& Files();
   uint64_t DPagingBegin() const;
   void SetDPagingBegin(uint64_t v);
@@ -57,23 +118,38 @@ class Task {
   void SetDPagingEnd(uint64_t v);
   uint64_t FileMapEnd() const;
   void SetFileMapEnd(uint64_t v);
+  /** @brief ファイルマップ領域の下端から bytes 以上をページ単位で確保し，先頭アドレスを返す。
+   * スレッドから同時に呼ばれても重ならないよう，割り込み禁止で確保する。 */
+  uint64_t ReserveFileMap(uint64_t bytes);
   std::vector<FileMapping>& FileMaps();
+  /** @brief ページフォールト時に読み込むイメージ（アプリ本体と共有ランタイム） */
+  std::vector<AppImage*>& Images();
+  /** @brief アプリが作った I/O リング。作っていなければ空 */
+  std::unique_ptr<IORing>& Ring();
+  /** @brief スレッドと共有する資源 */
+  std::shared_ptr<AppProcess>& Process();
 
   int Level() const { return level_; }
   bool Running() const { return running_; }
+  /** @brief 終了を求められているかを返す。
+   * 求められたタスクは待ちを中断し，システムコールからアプリへ戻るところで終了する。 */
+  bool KillPending() const { return kill_pending_; }
+  void RequestKill() { kill_pending_ = true; }
+  /** @brief アプリを実行している途中で割り込まれて止まっているかを返す。
+   * このときカーネルの処理は途中になっていないので，そのまま終了させてよい。 */
+  bool StoppedInUserMode() const { return (context_.cs & 3) == 3; }
 
  private:
   uint64_t id_;
-  std::vector<uint64_t> stack_;
+  /** @brief スタックプールから借りたスタックの終端。借りていなければ 0 */
+  uint64_t stack_end_{0};
   alignas(16) TaskContext context_;
   uint64_t os_stack_ptr_;
   std::deque<Message> msgs_;
   unsigned int level_{kDefaultLevel};
   bool running_{false};
-  std::vector<std::shared_ptr<::FileDescriptor>> files_{};
-  uint64_t dpaging_begin_{0}, dpaging_end_{0};
-  uint64_t file_map_end_{0};
-  std::vector<FileMapping> file_maps_{};
+  bool kill_pending_{false};
+  std::shared_ptr<AppProcess> process_;
 
   Task& SetLevel(int level) { level_ = level; return *this; }
   Task& SetRunning(bool running) { running_ = running; return *this; }
@@ -96,8 +172,19 @@ class TaskManager {
   Error Wakeup(uint64_t id, int level = -1);
   Error SendMessage(uint64_t id, const Message& msg);
   Task& CurrentTask();
+  /** @brief ID が一致するタスクを返す。見つからなければ nullptr */
+  Task* FindTask(uint64_t id);
+  /** @brief 実行中でないタスクを終了させる。実行中のタスク自身は Finish で終了すること。
+   *
+   * カーネルの処理の途中で止まっているタスクを終了させると，その処理は中途半端に残る。
+   * アプリのスレッドは RequestKill で終了を求め，自分で終了させること。
+   */
+  Error Kill(uint64_t id, int exit_code);
   void Finish(int exit_code);
+  /** @brief タスクの終了を待つ。待っているタスクが終了を求められると kInterrupted を返す。 */
   WithError<int> WaitFinish(uint64_t task_id);
+  /** @brief タスクが終了していれば終了コードを回収して返す。終了を待たない。 */
+  std::optional<int> PollFinish(uint64_t task_id);
 
  private:
   std::vector<std::unique_ptr<Task>> tasks_{};
@@ -110,6 +197,8 @@ class TaskManager {
 
   void ChangeLevelRunning(Task* task, int level);
   Task* RotateCurrentRunQueue(bool current_sleep);
+  /** @brief 実行中のタスクが変わったら per_cpu_data に反映する． */
+  void UpdatePerCPU();
 };
 
 extern TaskManager* task_manager;
@@ -1,5 +1,6 @@
 #include "terminal.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -13,6 +14,11 @@
 #include "timer.hpp"
 #include "keyboard.hpp"
 #include "logger.hpp"
+#include "log_buffer.hpp"
+#include "block_cache.hpp"
+#include "sysinfo.hpp"
+#include "stack_pool.hpp"
+#include "thread.hpp"
 
 namespace {
 
@@ -68,58 +74,8 @@ WithError<int> MakeArgVector(char* command, char* first_arg,
   return { argc, MAKE_ERROR(Error::kSuccess) };
 }
 
-Elf64_Phdr* GetProgramHeader(Elf64_Ehdr* ehdr) {
-  return reinterpret_cast<Elf64_Phdr*>(
-      reinterpret_cast<uintptr_t>(ehdr) + ehdr->e_phoff);
-}
-
-uintptr_t GetFirstLoadAddress(Elf64_Ehdr* ehdr) {
-  auto phdr = GetProgramHeader(ehdr);
-  for (int i = 0; i < ehdr->e_phnum; ++i) {
-    if (phdr[i].p_type != PT_LOAD) continue;
-    return phdr[i].p_vaddr;
-  }
-  return 0;
-}
-
 static_assert(kBytesPerFrame >= 4096);
 
-WithError<uint64_t> CopyLoadSegments(Elf64_Ehdr* ehdr) {
-  auto phdr = GetProgramHeader(ehdr);
-  uint64_t last_addr = 0;
-  for (int i = 0; i < ehdr->e_phnum; ++i) {
-    if (phdr[i].p_type != PT_LOAD) continue;
-
-    LinearAddress4Level dest_addr;
-    dest_addr.value = phdr[i].p_vaddr;
-    last_addr = std::max(last_addr, phdr[i].p_vaddr + phdr[i].p_memsz);
-    const auto num_4kpages = (phdr[i].p_memsz + 4095) / 4096;
-
-    if (auto err = SetupPageMaps(dest_addr, num_4kpages, false)) {
-      return {last_addr, err};
-    }
-
-    const auto src = reinterpret_cast<uint8_t*>(ehdr) + phdr[i].p_offset;
-    const auto dst = reinterpret_cast<uint8_t*>(phdr[i].p_vaddr);
-    memcpy(dst, src, phdr[i].p_filesz);
-    memset(dst + phdr[i].p_filesz, 0, phdr[i].p_memsz - phdr[i].p_filesz);
-  }
-  return {last_addr, MAKE_ERROR(Error::kSuccess)};
-}
-
-WithError<uint64_t> LoadELF(Elf64_Ehdr* ehdr) {
-  if (ehdr->e_type != ET_EXEC) {
-    return {0, MAKE_ERROR(Error::kInvalidFormat)};
-  }
-
-  const auto addr_first = GetFirstLoadAddress(ehdr);
-  if (addr_first < 0xffff'8000'0000'0000) {
-    return {0, MAKE_ERROR(Error::kInvalidFormat)};
-  }
-
-  return CopyLoadSegments(ehdr);
-}
-
 WithError<PageMapEntry*> SetupPML4(Task& current_task) {
   auto pml4 = NewPageMap();
   if (pml4.error) {
@@ -169,44 +125,61 @@ void ListAllEntries(FileDescriptor& fd, uint32_t dir_cluster) {
   }
 }
 
+/** @brief 全アプリで共有するランタイム。libc などを固定アドレスにリンクしたもので，
+ * アプリは --just-symbols でその関数を直接呼ぶ。 */
+const char* const kRuntimePath = "/apps/runtime";
+
+/** @brief アプリと共有ランタイムのイメージを取得し，タスクのページテーブルを作る。
+ *
+ * 取得したイメージは task.Images() に積む。失敗しても積んだ分は呼び出し側で手放す。
+ */
 WithError<AppLoadInfo> LoadApp(fat::DirectoryEntry& file_entry, Task& task) {
-  PageMapEntry* temp_pml4;
-  if (auto [pml4, err] = SetupPML4(task); err) {
+  auto [app_load, err] = AcquireAppImage(file_entry);
+  if (err) {
     return {{}, err};
-  } else {
-    temp_pml4 = pml4;
-  }
-
-  if (auto it = app_loads->find(&file_entry); it != app_loads->end()) {
-    AppLoadInfo app_load = it->second;
-    auto err = CopyPageMaps(temp_pml4, app_load.pml4, 4, 256);
-    app_load.pml4 = temp_pml4;
-    return {app_load, err};
   }
-
-  std::vector<uint8_t> file_buf(file_entry.file_size);
-  fat::LoadFile(&file_buf[0], file_buf.size(), file_entry);
-
-  auto elf_header = reinterpret_cast<Elf64_Ehdr*>(&file_buf[0]);
-  if (memcmp(elf_header->e_ident, "\x7f" "ELF", 4) != 0) {
-    return {{}, MAKE_ERROR(Error::kInvalidFile)};
+  task.Images().push_back(app_load.image);
+  if (app_load.entry == 0) {
+    // エントリポイントを持たない共有ランタイムは単独では実行できない
+    return {app_load, MAKE_ERROR(Error::kInvalidFormat)};
   }
 
-  auto [last_addr, err_load] = LoadELF(elf_header);
-  if (err_load) {
-    return {{}, err_load};
+  AppImage* runtime_image = nullptr;
+  if (auto [entry, post_slash] = fat::FindFile(kRuntimePath); entry && !post_slash) {
+    if (auto [runtime_load, err] = AcquireAppImage(*entry); err) {
+      Log(kWarn, "failed to load %s: %s\n", kRuntimePath, err.Name());
+    } else {
+      runtime_image = runtime_load.image;
+      task.Images().push_back(runtime_image);
+    }
   }
 
-  AppLoadInfo app_load{last_addr, elf_header->e_entry, temp_pml4};
-  app_loads->insert(std::make_pair(&file_entry, app_load));
-
+  // これまでに読み込んだページを共有し，残りはページフォールト時に読み込む
+  const auto image_pml4 = app_load.pml4;
   if (auto [pml4, err] = SetupPML4(task); err) {
     return {app_load, err};
   } else {
     app_load.pml4 = pml4;
   }
-  auto err = CopyPageMaps(app_load.pml4, temp_pml4, 4, 256);
-  return {app_load, err};
+  if (auto err = CopyPageMaps(app_load.pml4, image_pml4, 4, 256)) {
+    return {app_load, err};
+  }
+  if (auto err = MapSysInfo()) {
+    return {app_load, err};
+  }
+  if (runtime_image) {
+    // ランタイムはアプリ本体とは別の PML4 エントリに置かれている
+    return {app_load, CopyPageMaps(app_load.pml4, runtime_image->pml4, 4, 256)};
+  }
+  return {app_load, MAKE_ERROR(Error::kSuccess)};
+}
+
+/** @brief LoadApp で取得したイメージを手放す。 */
+void ReleaseImages(Task& task) {
+  for (auto image : task.Images()) {
+    ReleaseAppImage(image);
+  }
+  task.Images().clear();
 }
 
 fat::DirectoryEntry* FindCommand(const char* command, unsigned long dir_cluster = 0) {
@@ -230,9 +203,36 @@ fat::DirectoryEntry* FindCommand(const char* command, unsigned long dir_cluster
   return FindCommand(command, apps_entry.first->FirstCluster());
 }
 
-} // namespace
+/** @brief 前後の空白を取り除く。末尾の空白は 0 で上書きする。 */
+char* TrimSpaces(char* s) {
+  while (isspace(*s)) {
+    ++s;
+  }
+  char* last = s + strlen(s);
+  while (last > s && isspace(last[-1])) {
+    --last;
+  }
+  *last = 0;
+  return s;
+}
+
+/** @brief taskbench で生成するタスク。何もせずに終了する。 */
+void TaskExitImmediately(uint64_t task_id, int64_t data) {
+  __asm__("cli");
+  task_manager->Finish(0);
+}
 
-std::map<fat::DirectoryEntry*, AppLoadInfo>* app_loads;
+/** @brief TSC のサイクル数をナノ秒に直す。 */
+unsigned long CyclesToNanoseconds(unsigned long cycles) {
+  if (tsc_freq == 0) {
+    return 0;
+  }
+  // 長い時間を測っても桁あふれしないよう，秒の単位と端数に分けて換算する
+  return cycles / tsc_freq * 1000'000'000ul +
+         cycles % tsc_freq * 1000'000'000ul / tsc_freq;
+}
+
+} // namespace
 
 Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
     : task_{task} {
@@ -248,6 +248,12 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
     }
   }
 
+  // ウィンドウを持たない端末ではスクロールバックを保持しない
+  lines_.resize(kRows + (show_window_ ? kScrollbackLines : 0));
+  for (auto& line : lines_) {
+    line.fill({0, 0});
+  }
+
   if (show_window_) {
     window_ = std::make_shared<ToplevelWindow>(
         kColumns * 8 + 8 + ToplevelWindow::kMarginX,
@@ -267,17 +273,12 @@ Terminal::Terminal(Task& task, const TerminalDescriptor* term_desc)
 }
 
 Rectangle<int> Terminal::BlinkCursor() {
+  Lock();
   cursor_visible_ = !cursor_visible_;
-  DrawCursor(cursor_visible_);
-
-  return {CalcCursorPos(), {7, 15}};
-}
-
-void Terminal::DrawCursor(bool visible) {
-  if (show_window_) {
-    const auto color = visible ? ToColor(0xffffff) : ToColor(0);
-    FillRectangle(*window_->Writer(), CalcCursorPos(), {7, 15}, color);
-  }
+  MarkCursorDirty();
+  const auto area = Render();
+  Unlock();
+  return area;
 }
 
 Vector2D<int> Terminal::CalcCursorPos() const {
@@ -285,11 +286,17 @@ Vector2D<int> Terminal::CalcCursorPos() const {
       Vector2D<int>{4 + 8 * cursor_.x, 4 + 16 * cursor_.y};
 }
 
+void Terminal::MarkCursorDirty() {
+  MarkDirty(cursor_.y, cursor_.x, cursor_.x + 1);
+}
+
 Rectangle<int> Terminal::InputKey(
     uint8_t modifier, uint8_t keycode, char ascii) {
-  DrawCursor(false);
-
-  Rectangle<int> draw_area{CalcCursorPos(), {8*2, 16}};
+  Lock();
+  MarkCursorDirty();
+  if (view_offset_ > 0 && keycode != 0x4b && keycode != 0x4e) {
+    ScrollView(-view_offset_);
+  }
 
   if (ascii == '\n') {
     linebuf_[linebuf_index_] = 0;
@@ -306,17 +313,15 @@ Rectangle<int> Terminal::InputKey(
     } else {
       Scroll1();
     }
+    // 実行中のコマンドの各段が出力できるよう，コマンドの実行中はロックを手放す
+    Unlock();
     ExecuteLine();
+    Lock();
     Print(">");
-    draw_area.pos = ToplevelWindow::kTopLeftMargin;
-    draw_area.size = window_->InnerSize();
   } else if (ascii == '\b') {
     if (cursor_.x > 1) {
       --cursor_.x;
-      if (show_window_) {
-        FillRectangle(*window_->Writer(), CalcCursorPos(), {8, 16}, {0, 0, 0});
-      }
-      draw_area.pos = CalcCursorPos();
+      PutCell(cursor_.y, cursor_.x, {0, 0});
 
       if (linebuf_index_ > 0) {
         --linebuf_index_;
@@ -326,53 +331,163 @@ Rectangle<int> Terminal::InputKey(
     if (cursor_.x < kColumns - 1 && linebuf_index_ < kLineMax - 1) {
       linebuf_[linebuf_index_] = ascii;
       ++linebuf_index_;
-      if (show_window_) {
-        WriteAscii(*window_->Writer(), CalcCursorPos(), ascii, {255, 255, 255});
-      }
+      PutCell(cursor_.y, cursor_.x, {static_cast<char32_t>(ascii), 0xffffff});
       ++cursor_.x;
     }
   } else if (keycode == 0x51) { // down arrow
-    draw_area = HistoryUpDown(-1);
+    HistoryUpDown(-1);
   } else if (keycode == 0x52) { // up arrow
-    draw_area = HistoryUpDown(1);
+    HistoryUpDown(1);
+  } else if (keycode == 0x4b) { // page up
+    ScrollView(kRows / 2);
+  } else if (keycode == 0x4e) { // page down
+    ScrollView(-kRows / 2);
   }
 
-  DrawCursor(true);
-
-  return draw_area;
+  cursor_visible_ = true;
+  MarkCursorDirty();
+  const auto area = Render();
+  Unlock();
+  return area;
 }
 
 void Terminal::Scroll1() {
-  Rectangle<int> move_src{
-    ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4 + 16},
-    {8*kColumns, 16*(kRows - 1)}
-  };
-  window_->Move(ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4}, move_src);
-  FillRectangle(*window_->InnerWriter(),
-                {4, 4 + 16*cursor_.y}, {8*kColumns, 16}, {0, 0, 0});
+  top_ = (top_ + 1) % lines_.size();
+  num_scrollback_ = std::min<int>(num_scrollback_ + 1, lines_.size() - kRows);
+  ScreenLine(kRows - 1).fill({0, 0});
+
+  // 未反映の範囲も画素と一緒に 1 行上へずらす
+  for (int row = 0; row < kRows - 1; ++row) {
+    dirty_[row] = dirty_[row + 1];
+  }
+  dirty_[kRows - 1] = {0, kColumns};
+  ++pending_scroll_;
+}
+
+Terminal::Line& Terminal::ScreenLine(int row) {
+  return lines_[(top_ + row) % lines_.size()];
+}
+
+const Terminal::Line& Terminal::ViewLine(int row) const {
+  const int n = lines_.size();
+  return lines_[(top_ - view_offset_ + row + n) % n];
+}
+
+void Terminal::PutCell(int row, int column, TerminalCell cell) {
+  ScreenLine(row)[column] = cell;
+  MarkDirty(row, column, column + 1);
+}
+
+void Terminal::MarkDirty(int row, int first, int last) {
+  first = std::max(first, 0);
+  last = std::min(last, kColumns);
+  if (row < 0 || kRows <= row || first >= last) {
+    return;
+  }
+  auto& d = dirty_[row];
+  if (d.first >= d.second) {
+    d = {first, last};
+  } else {
+    d = {std::min(d.first, first), std::max(d.second, last)};
+  }
+}
+
+void Terminal::MarkAllDirty() {
+  dirty_.fill({0, kColumns});
+}
+
+void Terminal::ScrollView(int lines) {
+  const int new_offset = std::clamp(view_offset_ + lines, 0, num_scrollback_);
+  if (new_offset != view_offset_) {
+    view_offset_ = new_offset;
+    MarkAllDirty();
+  }
+}
+
+Rectangle<int> Terminal::Render() {
+  last_render_tick_ = timer_manager->CurrentTick();
+  if (!show_window_) {
+    dirty_.fill({0, 0});
+    pending_scroll_ = 0;
+    return {{0, 0}, {0, 0}};
+  }
+
+  const Vector2D<int> text_origin = ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4};
+  int row_first = kRows, row_last = -1;
+
+  // 溜まったスクロールはウィンドウ内の 1 回の移動で反映する
+  if (pending_scroll_ > 0) {
+    if (pending_scroll_ < kRows) {
+      Rectangle<int> move_src{
+        text_origin + Vector2D<int>{0, 16 * pending_scroll_},
+        {8*kColumns, 16*(kRows - pending_scroll_)}
+      };
+      window_->Move(text_origin, move_src);
+    } else {
+      MarkAllDirty();
+    }
+    pending_scroll_ = 0;
+    row_first = 0;
+    row_last = kRows - 1;
+  }
+
+  auto writer = window_->Writer();
+  for (int row = 0; row < kRows; ++row) {
+    auto [first, last] = dirty_[row];
+    if (first >= last) {
+      continue;
+    }
+    dirty_[row] = {0, 0};
+    row_first = std::min(row_first, row);
+    row_last = std::max(row_last, row);
+
+    const auto& line = ViewLine(row);
+    if (line[first].ch == TerminalCell::kWideTail && first > 0) {
+      --first;
+    }
+    const auto line_pos = text_origin + Vector2D<int>{0, 16 * row};
+    FillRectangle(*writer, line_pos + Vector2D<int>{8 * first, 0},
+                  {8 * (last - first), 16}, {0, 0, 0});
+    for (int col = first; col < last; ++col) {
+      const auto& cell = line[col];
+      if (cell.ch == 0 || cell.ch == TerminalCell::kWideTail) {
+        continue;
+      }
+      WriteUnicode(*writer, line_pos + Vector2D<int>{8 * col, 0},
+                   cell.ch, ToColor(cell.fg));
+    }
+  }
+
+  if (cursor_visible_ && view_offset_ == 0 && cursor_.x < kColumns) {
+    FillRectangle(*writer, CalcCursorPos(), {7, 15}, ToColor(0xffffff));
+  }
+
+  if (row_last < row_first) {
+    return {{0, 0}, {0, 0}};
+  }
+  return {text_origin + Vector2D<int>{0, 16 * row_first},
+          {8 * kColumns, 16 * (row_last - row_first + 1)}};
 }
 
 void Terminal::ExecuteLine() {
-  char* command = &linebuf_[0];
-  char* first_arg = strchr(&linebuf_[0], ' ');
-  char* redir_char = strchr(&linebuf_[0], '>');
-  char* pipe_char = strchr(&linebuf_[0], '|');
-  if (first_arg) {
-    *first_arg = 0;
-    do {
-      ++first_arg;
-    } while (isspace(*first_arg));
+  char* line = TrimSpaces(&linebuf_[0]);
+
+  // 行末の & はバックグラウンド実行の指定
+  bool background = false;
+  if (size_t len = strlen(line); len > 0 && line[len - 1] == '&') {
+    line[len - 1] = 0;
+    line = TrimSpaces(line);
+    background = true;
   }
+  const std::string job_command = line;
 
+  char* redir_char = strchr(line, '>');
   auto original_stdout = files_[1];
   int exit_code = 0;
 
   if (redir_char) {
     *redir_char = 0;
-    char* redir_dest = &redir_char[1];
-    while (isspace(*redir_dest)) {
-      ++redir_dest;
-    }
+    char* redir_dest = TrimSpaces(&redir_char[1]);
 
     auto [file, post_slash] = fat::FindFile(redir_dest);
     if (file == nullptr) {
@@ -390,31 +505,44 @@ void Terminal::ExecuteLine() {
     files_[1] = std::make_shared<fat::FileDescriptor>(*file);
   }
 
-  std::shared_ptr<PipeDescriptor> pipe_fd;
-  uint64_t subtask_id = 0;
-
-  if (pipe_char) {
-    *pipe_char = 0;
-    char* subcommand = &pipe_char[1];
-    while (isspace(*subcommand)) {
-      ++subcommand;
+  // | で区切られた各段を取り出す
+  std::vector<char*> stages;
+  for (char* p = line; p != nullptr; ) {
+    char* pipe_char = strchr(p, '|');
+    if (pipe_char) {
+      *pipe_char = 0;
     }
+    stages.push_back(TrimSpaces(p));
+    p = pipe_char ? &pipe_char[1] : nullptr;
+  }
 
-    auto& subtask = task_manager->NewTask();
-    pipe_fd = std::make_shared<PipeDescriptor>(subtask);
-    auto term_desc = new TerminalDescriptor{
-      subcommand, true, false,
-      {pipe_fd, files_[1], files_[2]}
-    };
-    files_[1] = pipe_fd;
+  const bool has_empty_stage = std::any_of(
+      stages.begin(), stages.end(), [](char* s){ return s[0] == 0; });
+  if (stages.size() > 1 && has_empty_stage) {
+    PrintToFD(*files_[2], "syntax error near |\n");
+    exit_code = 1;
+  } else if (stages.size() == 1 && !background) {
+    exit_code = ExecuteCommand(stages[0]);
+  } else if (stages[0][0] != 0) {
+    exit_code = ExecutePipeline(stages, background, job_command);
+  }
 
-    subtask_id = subtask
-      .InitContext(TaskTerminal, reinterpret_cast<int64_t>(term_desc))
-      .Wakeup()
-      .ID();
-    (*layer_task_map)[layer_id_] = subtask_id;
+  last_exit_code_ = exit_code;
+  files_[1] = original_stdout;
+  ReportJobs(*files_[2], false);
+}
+
+int Terminal::ExecuteCommand(char* command) {
+  char* first_arg = strchr(command, ' ');
+  if (first_arg) {
+    *first_arg = 0;
+    do {
+      ++first_arg;
+    } while (isspace(*first_arg));
   }
 
+  int exit_code = 0;
+
   if (strcmp(command, "echo") == 0) {
     if (first_arg && first_arg[0] == '$') {
       if (strcmp(&first_arg[1], "?") == 0) {
@@ -425,11 +553,13 @@ void Terminal::ExecuteLine() {
     }
     PrintToFD(*files_[1], "\n");
   } else if (strcmp(command, "clear") == 0) {
-    if (show_window_) {
-      FillRectangle(*window_->InnerWriter(),
-                    {4, 4}, {8*kColumns, 16*kRows}, {0, 0, 0});
+    Lock();
+    for (int row = 0; row < kRows; ++row) {
+      ScreenLine(row).fill({0, 0});
     }
+    MarkAllDirty();
     cursor_.y = 0;
+    Unlock();
   } else if (strcmp(command, "lspci") == 0) {
     char s[64];
     for (int i = 0; i < pci::num_device; ++i) {
@@ -481,14 +611,12 @@ void Terminal::ExecuteLine() {
     }
     if (fd) {
       char u8buf[1024];
-      DrawCursor(false);
       while (true) {
         if (ReadDelim(*fd, '\n', u8buf, sizeof(u8buf)) == 0) {
           break;
         }
         PrintToFD(*files_[1], "%s", u8buf);
       }
-      DrawCursor(true);
     }
   } else if (strcmp(command, "noterm") == 0) {
     auto term_desc = new TerminalDescriptor{
@@ -509,6 +637,159 @@ void Terminal::ExecuteLine() {
       p_stat.total_frames,
       p_stat.total_frames * kBytesPerFrame / 1024 / 1024);
     PrintToFD(*files_[1], "%s",s);
+  } else if (strcmp(command, "fbbench") == 0) {
+    int count = 100;
+    if (first_arg && first_arg[0] != '\0') {
+      count = atoi(first_arg);
+    }
+    // 描画中は割り込みを禁止するので tick が進まない．TSC で測る
+    const Rectangle<int> screen_area{{0, 0}, ScreenSize()};
+    const auto tsc_start = __builtin_ia32_rdtsc();
+    for (int i = 0; i < count; ++i) {
+      __asm__("cli");
+      layer_manager->Draw(screen_area);
+      __asm__("sti");
+    }
+    const auto elapsed_ms =
+      CyclesToNanoseconds(__builtin_ia32_rdtsc() - tsc_start) / 1000'000;
+    PrintToFD(*files_[1], "%d full-screen presents in %lu ms\n",
+              count, elapsed_ms);
+  } else if (strcmp(command, "dentrybench") == 0) {
+    // 作業用ディレクトリに 5000 個のエントリを用意して FindFile の速さを測り，最後に片付ける
+    const int kNumEntries = 5000;
+    const char* kScratchDir = "/DENTBNCH";
+    int count = 1000;
+    if (first_arg && first_arg[0] != '\0') {
+      count = atoi(first_arg);
+    }
+
+    if (fat::FindFile(kScratchDir).first == nullptr) {
+      if (auto [entry, err] = fat::CreateDirectory(kScratchDir); err) {
+        PrintToFD(*files_[2], "failed to create %s: %s\n", kScratchDir, err.Name());
+        exit_code = 1;
+      }
+    }
+
+    char path[32];
+    int num_created = 0;
+    for (; num_created < kNumEntries && exit_code == 0; ++num_created) {
+      sprintf(path, "%s/DB%04d.DAT", kScratchDir, num_created);
+      if (fat::FindFile(path).first == nullptr) {
+        if (auto [entry, err] = fat::CreateFile(path); err) {
+          PrintToFD(*files_[2], "failed to create %s: %s\n", path, err.Name());
+          exit_code = 1;
+          break;
+        }
+      }
+    }
+
+    auto measure = [count](const char* path) {
+      const auto tick_start = timer_manager->CurrentTick();
+      for (int i = 0; i < count; ++i) {
+        fat::FindFile(path);
+      }
+      return (timer_manager->CurrentTick() - tick_start) * 1000 / kTimerFreq;
+    };
+
+    char hit_path[32], miss_path[32];
+    sprintf(hit_path, "%s/DB%04d.DAT", kScratchDir, kNumEntries - 1);
+    sprintf(miss_path, "%s/NOSUCH.DAT", kScratchDir);
+    for (bool cached : {false, true}) {
+      if (exit_code != 0) {
+        break;
+      }
+      fat::SetDentryCacheEnabled(cached);
+      const auto hit_ms = measure(hit_path);
+      const auto miss_ms = measure(miss_path);
+      PrintToFD(*files_[1], "%s: %d hits in %lu ms, %d misses in %lu ms\n",
+                cached ? "cached  " : "uncached", count, hit_ms, count, miss_ms);
+    }
+
+    for (int i = 0; i < num_created; ++i) {
+      sprintf(path, "%s/DB%04d.DAT", kScratchDir, i);
+      fat::RemoveFile(path);
+    }
+    if (fat::FindFile(kScratchDir).first != nullptr) {
+      if (auto err = fat::RemoveFile(kScratchDir)) {
+        PrintToFD(*files_[2], "failed to remove %s: %s\n", kScratchDir, err.Name());
+        exit_code = 1;
+      }
+    }
+  } else if (strcmp(command, "sync") == 0) {
+    const auto tick_start = timer_manager->CurrentTick();
+    auto [ stats, err ] = FlushBlockCache();
+    const auto elapsed_ms =
+      (timer_manager->CurrentTick() - tick_start) * 1000 / kTimerFreq;
+    if (err) {
+      PrintToFD(*files_[2], "failed to sync: %s\n", err.Name());
+      exit_code = 1;
+    } else {
+      PrintToFD(*files_[1], "%lu KiB in %lu requests, %lu ms\n",
+                stats.num_pages * 4, stats.num_requests, elapsed_ms);
+    }
+  } else if (strcmp(command, "appcache") == 0) {
+    const auto stats = GetAppCacheStats();
+    PrintToFD(*files_[1], "hits %lu, misses %lu, evictions %lu\n",
+              stats.hits, stats.misses, stats.evictions);
+    PrintToFD(*files_[1], "%lu images, %lu / %lu pages resident\n",
+              stats.num_images, stats.resident_pages, kAppCacheBudgetPages);
+    ForEachAppImage([this](const char* name, size_t num_pages, int num_users) {
+      PrintToFD(*files_[1], "  %-12s %5lu pages, %d running\n",
+                name, num_pages, num_users);
+    });
+  } else if (strcmp(command, "taskbench") == 0) {
+    // タスクの生成（NewTask と InitContext）と，起動してから終了するまでの時間を測る
+    int count = 1000;
+    if (first_arg && first_arg[0] != '\0') {
+      count = atoi(first_arg);
+    }
+    unsigned long create_cycles = 0, spawn_cycles = 0;
+    for (int i = 0; i < count; ++i) {
+      __asm__("cli");
+      const auto start = __builtin_ia32_rdtsc();
+      auto& task = task_manager->NewTask().InitContext(TaskExitImmediately, 0);
+      const auto created = __builtin_ia32_rdtsc();
+      const auto task_id = task.ID();
+      task.Wakeup();
+      task_manager->WaitFinish(task_id);
+      const auto finished = __builtin_ia32_rdtsc();
+      __asm__("sti");
+      create_cycles += created - start;
+      spawn_cycles += finished - start;
+    }
+    if (count > 0) {
+      PrintToFD(*files_[1], "%d tasks: create %lu ns, spawn to finish %lu ns (avg)\n",
+                count, CyclesToNanoseconds(create_cycles / count),
+                CyclesToNanoseconds(spawn_cycles / count));
+    }
+    const auto stats = GetTaskStackStats();
+    PrintToFD(*files_[1], "stacks: %lu mapped, %lu free, %lu allocations, %lu reused\n",
+              stats.num_stacks, stats.num_free, stats.num_allocations, stats.num_reuses);
+  } else if (strcmp(command, "dmesg") == 0) {
+    ForEachLog([this](const char* s, size_t len) {
+      files_[1]->Write(s, len);
+    });
+  } else if (strcmp(command, "jobs") == 0) {
+    ReportJobs(*files_[1], true);
+  } else if (strcmp(command, "wait") == 0) {
+    // 引数がなければすべてのジョブの終了を待つ
+    const int job_id = first_arg && first_arg[0] != '\0' ? atoi(first_arg) : 0;
+    bool found = false;
+    for (auto it = jobs_.begin(); it != jobs_.end(); ) {
+      if (job_id != 0 && it->id != job_id) {
+        ++it;
+        continue;
+      }
+      found = true;
+      // 出力を読まないと，パイプが満杯になったジョブが終わらない
+      DrainJobOutput(*it, true);
+      exit_code = WaitJob(*it);
+      it = jobs_.erase(it);
+    }
+    if (job_id != 0 && !found) {
+      PrintToFD(*files_[2], "no such job: %d\n", job_id);
+      exit_code = 1;
+    }
   } else if (command[0] != 0) {
     auto file_entry = FindCommand(command);
     if (!file_entry) {
@@ -525,20 +806,186 @@ void Terminal::ExecuteLine() {
     }
   }
 
-  if (pipe_fd) {
-    pipe_fd->FinishWrite();
+  return exit_code;
+}
+
+int Terminal::ExecutePipeline(const std::vector<char*>& stages,
+                              bool background, const std::string& command) {
+  std::shared_ptr<FileDescriptor> stage_in = files_[0];
+  if (background) {
+    // バックグラウンドのジョブには端末からの入力を渡さない。
+    // 書き込み側を閉じたパイプを標準入力とし，読むとすぐ EOF になるようにする。
+    stage_in = MakePipe(1).first;
+  }
+
+  // バックグラウンドのジョブから端末への出力は，パイプを通して端末のタスクが表示する。
+  // 端末のタスクが入力の処理などで Terminal を書き換えている最中に，
+  // 別のタスクから Terminal::Print を呼ばせないため
+  Job job{next_job_id_, command, {}, 0, 0};
+  std::shared_ptr<FileDescriptor> job_stdout = files_[1], job_stderr = files_[2];
+  if (background && show_window_ &&
+      (files_[1]->IsTerminal() || files_[2]->IsTerminal())) {
+    auto [ out_rd, out_wr ] = MakePipe();
+    job.output = out_rd;
+    if (files_[1]->IsTerminal()) {
+      job_stdout = out_wr;
+    }
+    if (files_[2]->IsTerminal()) {
+      job_stderr = out_wr;
+    }
+  }
+
+  // 段ごとにタスクを起こし，隣り合う段をパイプでつなぐ
+  for (size_t i = 0; i < stages.size(); ++i) {
+    std::shared_ptr<FileDescriptor> stage_out = job_stdout;
+    std::shared_ptr<FileDescriptor> next_in;
+    if (i + 1 < stages.size()) {
+      auto [ pipe_rd, pipe_wr ] = MakePipe();
+      stage_out = pipe_wr;
+      next_in = pipe_rd;
+    }
+
+    auto term_desc = new TerminalDescriptor{
+      stages[i], true, false,
+      {stage_in, stage_out, job_stderr}
+    };
+    job.task_ids.push_back(task_manager->NewTask()
+      .InitContext(TaskTerminal, reinterpret_cast<int64_t>(term_desc))
+      .Wakeup()
+      .ID());
+    stage_in = next_in;
+  }
+  job.last_task_id = job.task_ids.back();
+
+  if (background) {
+    PrintToFD(*files_[2], "[%d] %lu\n", job.id, job.last_task_id);
+    ++next_job_id_;
+    jobs_.push_back(std::move(job));
+    return 0;
+  }
+
+  // キー入力は先頭の段に届ける
+  if (show_window_) {
+    __asm__("cli");
+    (*layer_task_map)[layer_id_] = job.task_ids.front();
+    __asm__("sti");
+  }
+  const int exit_code = WaitJob(job);
+  if (show_window_) {
     __asm__("cli");
-    auto [ec, err] = task_manager->WaitFinish(subtask_id);
     (*layer_task_map)[layer_id_] = task_.ID();
     __asm__("sti");
+  }
+  return exit_code;
+}
+
+bool Terminal::PollJob(Job& job) {
+  auto& ids = job.task_ids;
+  for (auto it = ids.begin(); it != ids.end(); ) {
+    __asm__("cli");
+    const auto ec = task_manager->PollFinish(*it);
+    __asm__("sti");
+    if (!ec) {
+      ++it;
+      continue;
+    }
+    if (*it == job.last_task_id) {
+      job.exit_code = *ec;
+    }
+    it = ids.erase(it);
+  }
+  return ids.empty();
+}
+
+int Terminal::WaitJob(Job& job) {
+  for (auto id : job.task_ids) {
+    __asm__("cli");
+    auto [ec, err] = task_manager->WaitFinish(id);
+    __asm__("sti");
     if (err) {
       Log(kWarn, "failed to wait finish: %s\n", err.Name());
     }
-    exit_code = ec;
+    if (id == job.last_task_id) {
+      job.exit_code = ec;
+    }
   }
+  job.task_ids.clear();
+  return job.exit_code;
+}
 
-  last_exit_code_ = exit_code;
-  files_[1] = original_stdout;
+void Terminal::DrainJobOutput(Job& job, bool block) {
+  char buf[256];
+  size_t total = 0;
+  while (job.output && (block || total < Pipe::kDefaultCapacity)) {
+    if (!block) {
+      __asm__("cli");
+      const bool ready = job.output->PollRead(task_);
+      __asm__("sti");
+      if (!ready) {
+        return;
+      }
+    }
+
+    const size_t n = job.output->Read(buf, sizeof(buf));
+    if (n == 0) {
+      // 全段が出力を閉じたので，もう書かれることはない
+      __asm__("cli");
+      job.output->CancelPoll(task_);
+      __asm__("sti");
+      job.output.reset();
+      return;
+    }
+    Print(buf, n);
+    total += n;
+  }
+}
+
+void Terminal::DrainJobs() {
+  for (auto& job : jobs_) {
+    DrainJobOutput(job, false);
+  }
+  if (show_window_) {
+    Redraw();
+  }
+}
+
+bool Terminal::PollJobs() {
+  bool ready = false;
+  for (auto& job : jobs_) {
+    if (job.output && job.output->PollRead(task_)) {
+      ready = true;
+    }
+  }
+  return ready;
+}
+
+void Terminal::CloseJobOutputs() {
+  for (auto& job : jobs_) {
+    if (job.output) {
+      __asm__("cli");
+      job.output->CancelPoll(task_);
+      __asm__("sti");
+      job.output.reset();
+    }
+  }
+}
+
+void Terminal::ReportJobs(FileDescriptor& fd, bool show_running) {
+  for (auto it = jobs_.begin(); it != jobs_.end(); ) {
+    DrainJobOutput(*it, false);
+    if (PollJob(*it)) {
+      // 全段が終了していれば出力も閉じられているので，残りを読み切ってから報告する
+      DrainJobOutput(*it, true);
+      PrintToFD(fd, "[%d] Done(%d)  %s\n",
+                it->id, it->exit_code, it->command.c_str());
+      it = jobs_.erase(it);
+    } else {
+      if (show_running) {
+        PrintToFD(fd, "[%d] Running  %s\n", it->id, it->command.c_str());
+      }
+      ++it;
+    }
+  }
 }
 
 WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* command, char* first_arg) {
@@ -548,11 +995,13 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* comm
 
   auto [app_load, err] = LoadApp(file_entry, task);
   if (err) {
+    ReleaseImages(task);
     return {0, err};
   }
 
   LinearAddress4Level args_frame_addr{0xffff'ffff'ffff'f000};
   if (auto err = SetupPageMaps(args_frame_addr, 1)) {
+    ReleaseImages(task);
     return {0, err};
   }
   auto argv = reinterpret_cast<char**>(args_frame_addr.value);
@@ -561,12 +1010,14 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* comm
   int argbuf_len = 4095 - sizeof(char**) * argv_len;
   auto argc = MakeArgVector(command, first_arg, argv, argv_len, argbuf, argbuf_len);
   if (argc.error) {
+    ReleaseImages(task);
     return {0, argc.error};
   }
 
   const int stack_size = 16 * 4096;
   LinearAddress4Level stack_frame_addr{0xffff'ffff'ffff'f000 - stack_size};
   if (auto err = SetupPageMaps(stack_frame_addr, stack_size / 4096)) {
+    ReleaseImages(task);
     return {0, err};
   }
 
@@ -584,12 +1035,18 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* comm
                     stack_frame_addr.value + stack_size - 8,
                     &task.OSStackPointer());
 
+  // ページテーブルを片付ける前に，同じアプリのスレッドを止める
+  KillAppThreads(task);
   task.Files().clear();
   task.FileMaps().clear();
+  ReleaseIORing(task);
 
   if (auto err = CleanPageMaps(LinearAddress4Level{0xffff'8000'0000'0000})) {
+    ReleaseImages(task);
     return {ret, err};
   }
+  // タスクのページテーブルからイメージのページが外れてから手放す
+  ReleaseImages(task);
   return {ret, FreePML4(task)};
 }
 
@@ -610,23 +1067,27 @@ void Terminal::Print(char32_t c) {
   if (c == '\n') {
     newline();
   } else if (IsHankaku(c)) {
-    if (cursor_.x == kColumns) {
+    if (cursor_.x >= kColumns) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, {255, 255, 255});
+    PutCell(cursor_.y, cursor_.x, {c, 0xffffff});
     ++cursor_.x;
   } else {
-    if (cursor_.x == kColumns - 1) {
+    if (cursor_.x >= kColumns - 1) {
       newline();
     }
-    WriteUnicode(*window_->Writer(), CalcCursorPos(), c, {255, 255, 255});
+    PutCell(cursor_.y, cursor_.x, {c, 0xffffff});
+    PutCell(cursor_.y, cursor_.x + 1, {TerminalCell::kWideTail, 0xffffff});
     cursor_.x += 2;
   }
 }
 
 void Terminal::Print(const char* s, std::optional<size_t> len) {
-  const auto cursor_before = CalcCursorPos();
-  DrawCursor(false);
+  Lock();
+  MarkCursorDirty();
+  if (view_offset_ > 0) {
+    ScrollView(-view_offset_);
+  }
 
   size_t i = 0;
   const size_t len_ = len ? *len : std::numeric_limits<size_t>::max();
@@ -636,45 +1097,79 @@ void Terminal::Print(const char* s, std::optional<size_t> len) {
     Print(u32);
     i += bytes;
   }
+  MarkCursorDirty();
 
-  DrawCursor(true);
-  const auto cursor_after = CalcCursorPos();
-
-  Vector2D<int> draw_pos{ToplevelWindow::kTopLeftMargin.x, cursor_before.y};
-  Vector2D<int> draw_size{window_->InnerSize().x,
-                          cursor_after.y - cursor_before.y + 16};
-
-  Rectangle<int> draw_area{draw_pos, draw_size};
+  if (timer_manager->CurrentTick() - last_render_tick_ >= kRenderIntervalTicks) {
+    Redraw();
+  } else if (show_window_) {
+    // この後に書き込みがなくても反映されるようにしておく
+    __asm__("cli");
+    ScheduleRender();
+    __asm__("sti");
+  }
+  Unlock();
+}
 
+void Terminal::Redraw() {
+  Lock();
+  const auto draw_area = Render();
+  Unlock();
+  if (draw_area.size.x <= 0 || draw_area.size.y <= 0) {
+    return;
+  }
   Message msg = MakeLayerMessage(
-      task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
+    task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
   __asm__("cli");
   task_manager->SendMessage(1, msg);
   __asm__("sti");
 }
 
-void Terminal::Redraw() {
-  Rectangle<int> draw_area{ToplevelWindow::kTopLeftMargin, window_->InnerSize()};
-  Message msg = MakeLayerMessage(
-    task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
+void Terminal::Lock() {
+  while (true) {
+    __asm__("cli");
+    auto& task = task_manager->CurrentTask();
+    if (lock_owner_ == nullptr || lock_owner_ == &task) {
+      lock_owner_ = &task;
+      ++lock_depth_;
+      __asm__("sti");
+      return;
+    }
+    lock_waiters_.push_back(&task);
+    task.Sleep();
+    __asm__("sti");
+  }
+}
+
+bool Terminal::TryLock() {
+  auto& task = task_manager->CurrentTask();
+  if (lock_owner_ != nullptr && lock_owner_ != &task) {
+    return false;
+  }
+  lock_owner_ = &task;
+  ++lock_depth_;
+  return true;
+}
+
+void Terminal::Unlock() {
   __asm__("cli");
-  task_manager->SendMessage(1, msg);
+  if (--lock_depth_ == 0) {
+    lock_owner_ = nullptr;
+    // 起こされたタスクは取り合い，取れなければ待ちに戻る
+    for (auto waiter : lock_waiters_) {
+      waiter->Wakeup();
+    }
+    lock_waiters_.clear();
+  }
   __asm__("sti");
 }
 
-Rectangle<int> Terminal::HistoryUpDown(int direction) {
+void Terminal::HistoryUpDown(int direction) {
   if (direction == -1 && cmd_history_index_ >= 0) {
     --cmd_history_index_;
   } else if (direction == 1 && cmd_history_index_ + 1 < cmd_history_.size()) {
     ++cmd_history_index_;
   }
 
-  cursor_.x = 1;
-  const auto first_pos = CalcCursorPos();
-
-  Rectangle<int> draw_area{first_pos, {8*(kColumns - 1), 16}};
-  FillRectangle(*window_->Writer(), draw_area.pos, draw_area.size, {0, 0, 0});
-
   const char* history = "";
   if (cmd_history_index_ >= 0) {
     history = &cmd_history_[cmd_history_index_][0];
@@ -683,13 +1178,16 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   strcpy(&linebuf_[0], history);
   linebuf_index_ = strlen(history);
 
-  WriteString(*window_->Writer(), first_pos, history, {255, 255, 255});
+  auto& line = ScreenLine(cursor_.y);
+  for (int col = 1; col < kColumns; ++col) {
+    const int i = col - 1;
+    line[col] = {i < linebuf_index_ ? static_cast<char32_t>(history[i]) : 0,
+                 0xffffff};
+  }
+  MarkDirty(cursor_.y, 1, kColumns);
   cursor_.x = linebuf_index_ + 1;
-  return draw_area;
 }
 
-std::map<uint64_t, Terminal*>* terminals;
-
 void TaskTerminal(uint64_t task_id, int64_t data) {
   const auto term_desc = reinterpret_cast<TerminalDescriptor*>(data);
   bool show_window = true;
@@ -716,8 +1214,11 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
 
   if (term_desc && term_desc->exit_after_command) {
     delete term_desc;
+    // 端末が持つファイルを解放し，パイプの読み出し側などを閉じる
+    const int exit_code = terminal->LastExitCode();
+    delete terminal;
     __asm__("cli");
-    task_manager->Finish(terminal->LastExitCode());
+    task_manager->Finish(exit_code);
     __asm__("sti");
   }
 
@@ -730,10 +1231,15 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
   bool window_isactive = false;
 
   while (true) {
+    terminal->DrainJobs();
+
     __asm__("cli");
     auto msg = task.ReceiveMessage();
     if (!msg) {
-      task.Sleep();
+      // ジョブの出力が届いていれば，眠らずに表示しに戻る
+      if (!terminal->PollJobs()) {
+        task.Sleep();
+      }
       __asm__("sti");
       continue;
     }
@@ -770,6 +1276,9 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
       break;
     case Message::kWindowClose:
       CloseLayer(msg->arg.window_close.layer_id);
+      terminal->CloseJobOutputs();
+      // 端末のタスクがいなくなった後にメインタスクから反映させない
+      terminal->CancelDeferredRender();
       __asm__("cli");
       task_manager->Finish(terminal->LastExitCode());
       break;
@@ -779,22 +1288,96 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
   }
 }
 
+namespace {
+  /** @brief 反映を遅らせている端末．割り込み禁止で触る． */
+  std::deque<Terminal*>* deferred_terminals;
+}
+
+Terminal::~Terminal() {
+  CancelDeferredRender();
+}
+
+void Terminal::CancelDeferredRender() {
+  // メインタスクが反映している途中なら終わるのを待つ
+  Lock();
+  show_window_ = false;
+  __asm__("cli");
+  if (deferred_terminals) {
+    deferred_terminals->erase(
+        std::remove(deferred_terminals->begin(), deferred_terminals->end(), this),
+        deferred_terminals->end());
+  }
+  render_scheduled_ = false;
+  __asm__("sti");
+  Unlock();
+}
+
+void Terminal::ScheduleRender() {
+  if (render_scheduled_) {
+    return;
+  }
+  render_scheduled_ = true;
+  if (deferred_terminals == nullptr) {
+    deferred_terminals = new std::deque<Terminal*>;
+  }
+  deferred_terminals->push_back(this);
+  timer_manager->AddTimer(
+      Timer{last_render_tick_ + kRenderIntervalTicks, kTerminalRenderTimer, 1});
+}
+
+void Terminal::RenderDeferred() {
+  __asm__("cli");
+  size_t n = deferred_terminals ? deferred_terminals->size() : 0;
+  __asm__("sti");
+
+  for (; n > 0; --n) {
+    __asm__("cli");
+    if (deferred_terminals->empty()) {
+      __asm__("sti");
+      break;
+    }
+    auto term = deferred_terminals->front();
+    deferred_terminals->pop_front();
+    term->render_scheduled_ = false;
+    if (!term->TryLock()) {
+      // 出力中のタスクがいれば，もう少し後で反映し直す
+      term->ScheduleRender();
+      __asm__("sti");
+      continue;
+    }
+    __asm__("sti");
+
+    term->Redraw();
+    term->Unlock();
+  }
+}
+
 TerminalFileDescriptor::TerminalFileDescriptor(Terminal& term)
   : term_{term} {}
 
 size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
   char* bufc = reinterpret_cast<char*>(buf);
+  term_.Redraw();
 
   while (true) {
     __asm__("cli");
-    auto msg = term_.UnderlyingTask().ReceiveMessage();
+    // パイプラインの段として別タスクから読まれることもあるため，
+    // キー入力は呼び出し元のタスクで受け取る
+    // キー入力以外のメッセージは ReadEvent などのために残しておく
+    auto& task = task_manager->CurrentTask();
+    auto msg = task.ReceiveMessageIf(
+        [](const Message& m) { return m.type == Message::kKeyPush; });
+    if (!msg && task.KillPending()) {
+      __asm__("sti");
+      return 0;
+    }
     if (!msg) {
-      term_.UnderlyingTask().Sleep();
+      task.Sleep();
       continue;
     }
     __asm__("sti");
 
-    if (msg->type != Message::kKeyPush || !msg->arg.keyboard.press) {
+    if (!msg->arg.keyboard.press) {
       continue;
     }
     if (msg->arg.keyboard.modifier & (kLControlBitMask | kRControlBitMask)) {
@@ -816,74 +1399,20 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
 
 size_t TerminalFileDescriptor::Write(const void* buf, size_t len) {
   term_.Print(reinterpret_cast<const char*>(buf), len);
-  term_.Redraw();
   return len;
 }
 
-size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
-  return 0;
-}
-
-PipeDescriptor::PipeDescriptor(Task& task) : task_{task} {}
-
-size_t PipeDescriptor::Read(void* buf, size_t len) {
-  if (len_ > 0) {
-    const size_t copy_bytes = std::min(len_, len);
-    memcpy(buf, data_, copy_bytes);
-    len_ -= copy_bytes;
-    memmove(data_, &data_[copy_bytes], len_);
-    return copy_bytes;
-  }
-
-  if (closed_) {
-    return 0;
-  }
-
-  while (true) {
-    __asm__("cli");
-    auto msg = task_.ReceiveMessage();
-    if (!msg) {
-      task_.Sleep();
-      continue;
-    }
-    __asm__("sti");
-
-    if (msg->type != Message::kPipe) {
-      continue;
-    }
-
-    if (msg->arg.pipe.len == 0) {
-      closed_ = true;
-      return 0;
-    }
-
-    const size_t copy_bytes = std::min<size_t>(msg->arg.pipe.len, len);
-    memcpy(buf, msg->arg.pipe.data, copy_bytes);
-    len_ = msg->arg.pipe.len - copy_bytes;
-    memcpy(data_, &msg->arg.pipe.data[copy_bytes], len_);
-    return copy_bytes;
-  }
+void TerminalFileDescriptor::Flush() {
+  term_.Redraw();
 }
 
-size_t PipeDescriptor::Write(const void* buf, size_t len) {
-  auto bufc = reinterpret_cast<const char*>(buf);
-  Message msg{Message::kPipe};
-  size_t sent_bytes = 0;
-  while (sent_bytes < len) {
-    msg.arg.pipe.len = std::min(len - sent_bytes, sizeof(msg.arg.pipe.data));
-    memcpy(msg.arg.pipe.data, &bufc[sent_bytes], msg.arg.pipe.len);
-    sent_bytes += msg.arg.pipe.len;
-    __asm__("cli");
-    task_.SendMessage(msg);
-    __asm__("sti");
-  }
-  return len;
+bool TerminalFileDescriptor::PollRead(Task& task) {
+  // メッセージが届けばタスクは起こされるので，待ちの登録は要らない
+  return task.HasMessage([](const Message& m) {
+    return m.type == Message::kKeyPush && m.arg.keyboard.press;
+  });
 }
 
-void PipeDescriptor::FinishWrite() {
-  Message msg{Message::kPipe};
-  msg.arg.pipe.len = 0;
-  __asm__("cli");
-  task_.SendMessage(msg);
-  __asm__("sti");
+size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
+  return 0;
 }
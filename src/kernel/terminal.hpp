@@ -9,17 +9,14 @@
 #include <deque>
 #include <map>
 #include <optional>
+#include <string>
+#include <vector>
 #include "window.hpp"
+#include "app_cache.hpp"
 #include "task.hpp"
 #include "layer.hpp"
 #include "fat.hpp"
-
-struct AppLoadInfo {
-  uint64_t vaddr_end, entry;
-  PageMapEntry* pml4;
-};
-
-extern std::map<fat::DirectoryEntry*, AppLoadInfo>* app_loads;
+#include "pipe.hpp"
 
 struct TerminalDescriptor {
   std::string command_line;
@@ -28,50 +25,165 @@ struct TerminalDescriptor {
   std::array<std::shared_ptr<FileDescriptor>, 3> files;
 };
 
+/** @brief ターミナルの 1 文字分のセル */
+struct TerminalCell {
+  /** @brief 全角文字の右半分を表す ch の値 */
+  static constexpr char32_t kWideTail = 0xffffffff;
+
+  char32_t ch; // 0 なら空白
+  uint32_t fg; // 文字色（0xRRGGBB）
+};
+
+/** @brief 端末の反映を遅らせたときにメインタスクへ届けるタイマの値 */
+const int kTerminalRenderTimer = 2;
+
 class Terminal {
  public:
   static const int kRows = 15, kColumns = 60;
   static const int kLineMax = 128;
+  /** @brief 画面外に保持する過去の行数 */
+  static const int kScrollbackLines = 200;
+  /** @brief 出力中に画面へ反映する最小間隔（タイマ割り込みのカウント） */
+  static const unsigned long kRenderIntervalTicks = 2;
 
   Terminal(Task& task, const TerminalDescriptor* term_desc);
+  ~Terminal();
   unsigned int LayerID() const { return layer_id_; }
   Rectangle<int> BlinkCursor();
   Rectangle<int> InputKey(uint8_t modifier, uint8_t keycode, char ascii);
 
+  /** @brief 文字列をテキストモデルに書き込む。
+   *
+   * 画面への反映はまとめて行うため，前回の反映から kRenderIntervalTicks
+   * 経過していなければ書き込むだけで戻る。そのときはタイマを仕掛け，
+   * 書き込みが途絶えても期限が来ればメインタスクが RenderDeferred で反映する。
+   */
   void Print(const char* s, std::optional<size_t> len = std::nullopt);
 
   Task& UnderlyingTask() const { return task_; }
   int LastExitCode() const { return last_exit_code_; }
+  /** @brief 未反映の変更をウィンドウに描画し，変更範囲の再描画を要求する。 */
   void Redraw();
+  /** @brief 反映を遅らせた端末を反映する。kTerminalRenderTimer を受けたメインタスクが呼ぶ。 */
+  static void RenderDeferred();
+  /** @brief 遅らせていた反映を取りやめ，以降は反映しない。ウィンドウを閉じるときに呼ぶ。 */
+  void CancelDeferredRender();
+
+  /** @brief バックグラウンドのジョブの出力を待たずに読めるだけ表示する。 */
+  void DrainJobs();
+  /** @brief 表示を待っているジョブの出力があれば true を返す。
+   *
+   * なければ出力が届いたときに端末のタスクを起こすよう登録する。割り込み禁止で呼ぶこと。
+   */
+  bool PollJobs();
+  /** @brief ジョブの出力を読むのをやめる。端末を閉じるときに呼ぶ。 */
+  void CloseJobOutputs();
 
  private:
+  using Line = std::array<TerminalCell, kColumns>;
+
   std::shared_ptr<ToplevelWindow> window_;
   unsigned int layer_id_;
   Task& task_;
 
   Vector2D<int> cursor_{0, 0};
   bool cursor_visible_{false};
-  void DrawCursor(bool visible);
   Vector2D<int> CalcCursorPos() const;
+  void MarkCursorDirty();
 
   int linebuf_index_{0};
   std::array<char, kLineMax> linebuf_{};
   void Scroll1();
 
+  /** @brief 画面の行とスクロールバックを保持するリングバッファ */
+  std::vector<Line> lines_;
+  /** @brief 画面の 0 行目に対応する lines_ の添字 */
+  int top_{0};
+  /** @brief 画面の上に保持されている過去の行数 */
+  int num_scrollback_{0};
+  /** @brief スクロールバック表示中に遡っている行数。0 なら最新の画面を表示 */
+  int view_offset_{0};
+  /** @brief 未反映のスクロール行数 */
+  int pending_scroll_{0};
+  /** @brief 各行の未反映の列の範囲 [first, second) */
+  std::array<std::pair<int, int>, kRows> dirty_{};
+  unsigned long last_render_tick_{0};
+
+  /** @brief 端末の状態を触るタスクを 1 つに限るロック。
+   *
+   * パイプラインの各段は同じレベルの別々のタスクから同時に出力するため，
+   * Print や Redraw などの入口で取る。同じタスクなら重ねて取れる。
+   */
+  Task* lock_owner_{nullptr};
+  int lock_depth_{0};
+  std::deque<Task*> lock_waiters_{};
+  void Lock();
+  /** @brief ロックが空いていれば取って true を返す。待たない。割り込み禁止で呼ぶこと。 */
+  bool TryLock();
+  void Unlock();
+
+  /** @brief 反映を遅らせていて，RenderDeferred を待っている */
+  bool render_scheduled_{false};
+  /** @brief kRenderIntervalTicks 後に反映するよう予約する。割り込み禁止で呼ぶこと。 */
+  void ScheduleRender();
+
+  Line& ScreenLine(int row);
+  const Line& ViewLine(int row) const;
+  void PutCell(int row, int column, TerminalCell cell);
+  void MarkDirty(int row, int first, int last);
+  void MarkAllDirty();
+  void ScrollView(int lines);
+  /** @brief 未反映の変更をウィンドウに描画し，描画した範囲を返す。 */
+  Rectangle<int> Render();
+
   void ExecuteLine();
+  /** @brief 1 つのコマンドをこの端末のタスクで実行し，終了コードを返す。 */
+  int ExecuteCommand(char* command);
+  /** @brief 各段を別々のタスクで同時に実行する。
+   *
+   * background が false なら全段の終了を待ち，最終段の終了コードを返す。
+   * true ならジョブとして登録してすぐに戻る。
+   */
+  int ExecutePipeline(const std::vector<char*>& stages,
+                      bool background, const std::string& command);
   WithError<int> ExecuteFile(fat::DirectoryEntry& file_entry, char* command, char* first_arg);
   void Print(char32_t c);
 
   std::deque<std::array<char, kLineMax>> cmd_history_{};
   int cmd_history_index_{-1};
-  Rectangle<int> HistoryUpDown(int direction);
+  void HistoryUpDown(int direction);
 
   bool show_window_;
   std::array<std::shared_ptr<FileDescriptor>, 3> files_;
   int last_exit_code_{0};
+
+  /** @brief パイプラインとして実行中のジョブ */
+  struct Job {
+    int id;
+    std::string command;
+    std::vector<uint64_t> task_ids; // まだ終了を回収していない段のタスク
+    uint64_t last_task_id; // 最終段のタスク
+    int exit_code; // 最終段の終了コード
+    /** @brief 端末へ向かう出力を受けるパイプの読み出し側。端末のタスクだけが読む */
+    std::shared_ptr<FileDescriptor> output{};
+  };
+  std::vector<Job> jobs_{};
+  int next_job_id_{1};
+
+  /** @brief 終了した段を回収し，全段が終了していれば true を返す。 */
+  bool PollJob(Job& job);
+  /** @brief 全段の終了を待ち，最終段の終了コードを返す。 */
+  int WaitJob(Job& job);
+  /** @brief ジョブの出力を表示する。
+   *
+   * block が true なら全段が出力を閉じるまで読み続ける。
+   * false なら待たずに読める分（最大でパイプ 1 つ分）だけ読む。
+   */
+  void DrainJobOutput(Job& job, bool block);
+  /** @brief 終了したジョブを報告して取り除く。 */
+  void ReportJobs(FileDescriptor& fd, bool show_running);
 };
 
-extern std::map<uint64_t, Terminal*>* terminals;
 void TaskTerminal(uint64_t task_id, int64_t data);
 
 class TerminalFileDescriptor : public FileDescriptor {
@@ -81,24 +193,10 @@ public:
   size_t Write(const void* buf, size_t len) override;
   size_t Size()const override { return 0; }
   size_t Load(void* buf, size_t len, size_t offset) override;
+  void Flush() override;
+  bool PollRead(Task& task) override;
+  bool IsTerminal() const override { return true; }
 
 private:
   Terminal& term_;
 };
-
-class PipeDescriptor : public FileDescriptor {
-public:
-  explicit PipeDescriptor(Task& task);
-  size_t Read(void* buf, size_t len) override;
-  size_t Write(const void* buf, size_t len) override;
-  size_t Size() const override { return 0; }
-  size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
-
-  void FinishWrite();
-
-private:
-  Task& task_;
-  char data_[16];
-  size_t len_{0};
-  bool closed_{false};
-};
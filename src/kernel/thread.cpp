@@ -0,0 +1,157 @@
+/**
+ * @file thread.cpp
+ *
+ * アプリのスレッドの実装．
+ */
+
+#include "thread.hpp"
+
+#include <algorithm>
+
+#include "asmfunc.h"
+#include "memory_manager.hpp"
+#include "paging.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+  struct ThreadStart {
+    uint64_t entry, arg, stack_top;
+  };
+
+  void AppThreadMain(uint64_t task_id, int64_t data) {
+    const auto start_ptr = reinterpret_cast<ThreadStart*>(data);
+    const auto start = *start_ptr;
+    delete start_ptr;
+
+    __asm__("cli");
+    auto& task = task_manager->CurrentTask();
+    if (task.KillPending()) {
+      task_manager->Finish(-1);
+    }
+    __asm__("sti");
+
+    const int ret = CallApp(0, reinterpret_cast<char**>(start.arg), 3 << 3 | 3,
+                            start.entry, start.stack_top, &task.OSStackPointer());
+
+    __asm__("cli");
+    task_manager->Finish(ret);
+  }
+
+  bool IsThreadOf(Task& task, uint64_t thread_id) {
+    const auto& threads = task.Process()->threads;
+    return std::find(threads.begin(), threads.end(), thread_id) != threads.end();
+  }
+}
+
+WithError<uint64_t> CreateAppThread(Task& task, uint64_t entry, uint64_t arg) {
+  auto& process = *task.Process();
+
+  __asm__("cli");
+  if (process.exiting) {
+    __asm__("sti");
+    return {0, MAKE_ERROR(Error::kInterrupted)};
+  }
+  uint64_t stack_begin = 0;
+  if (!process.free_thread_stacks.empty()) {
+    stack_begin = process.free_thread_stacks.back();
+    process.free_thread_stacks.pop_back();
+  }
+  __asm__("sti");
+
+  if (stack_begin == 0) {
+    // ファイルマップ領域と同様に，アプリ本体のスタックの下から順に割り当てる．
+    // 上下の 1 ページずつはマップせずに残す
+    stack_begin =
+      task.ReserveFileMap(kAppThreadStackBytes + 2 * kBytesPerFrame) + kBytesPerFrame;
+    if (auto err = SetupPageMaps(LinearAddress4Level{stack_begin},
+                                 kAppThreadStackBytes / kBytesPerFrame)) {
+      return {0, err};
+    }
+  }
+  const uint64_t stack_end = stack_begin + kAppThreadStackBytes;
+
+  // アプリ本体と同じく，call 直後のスタックの形にしておく
+  auto start = new ThreadStart{entry, arg, stack_end - 8};
+
+  __asm__("cli");
+  if (process.exiting) {
+    // スタックはアプリの終了時にページテーブルごと片付けられる
+    __asm__("sti");
+    delete start;
+    return {0, MAKE_ERROR(Error::kInterrupted)};
+  }
+  auto& thread = task_manager->NewTask();
+  thread.Process() = task.Process();
+  thread.InitContext(AppThreadMain, reinterpret_cast<int64_t>(start));
+  process.threads.push_back(thread.ID());
+  process.thread_stacks[thread.ID()] = stack_begin;
+  thread.Wakeup();
+  __asm__("sti");
+
+  return {thread.ID(), MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<int> JoinAppThread(Task& task, uint64_t thread_id) {
+  if (!IsThreadOf(task, thread_id)) {
+    return {0, MAKE_ERROR(Error::kNoSuchTask)};
+  }
+
+  __asm__("cli");
+  auto [ exit_code, err ] = task_manager->WaitFinish(thread_id);
+  if (!err) {
+    auto& process = *task.Process();
+    process.threads.erase(
+        std::remove(process.threads.begin(), process.threads.end(), thread_id),
+        process.threads.end());
+    // 終了したスレッドのスタックはもう使われないので，次のスレッドに回す
+    if (auto it = process.thread_stacks.find(thread_id);
+        it != process.thread_stacks.end()) {
+      process.free_thread_stacks.push_back(it->second);
+      process.thread_stacks.erase(it);
+    }
+  }
+  __asm__("sti");
+  return {exit_code, err};
+}
+
+void KillAppThreads(Task& task) {
+  auto& threads = task.Process()->threads;
+
+  __asm__("cli");
+  task.Process()->exiting = true;
+  while (true) {
+    for (auto it = threads.begin(); it != threads.end();) {
+      const auto id = *it;
+      auto thread = task_manager->FindTask(id);
+      if (thread && thread->StoppedInUserMode()) {
+        // カーネルの処理の途中ではないので，その場で終了させてよい
+        task_manager->Kill(id, -1);
+      } else if (thread) {
+        // システムコールの途中なら，待ちを中断させてアプリへ戻るところで終了させる
+        thread->RequestKill();
+        thread->Wakeup();
+        ++it;
+        continue;
+      }
+      // 終了コードを回収するものはいないので捨てる
+      task_manager->PollFinish(id);
+      it = threads.erase(it);
+    }
+    if (threads.empty()) {
+      break;
+    }
+
+    // 残ったスレッドはシステムコールから戻るか，アプリの実行中に割り込まれると終了できる
+    timer_manager->AddTimer(
+        Timer{timer_manager->CurrentTick() + 1, kWakeupTimerValue, task.ID()});
+    task.Sleep();
+    __asm__("cli");
+  }
+  // 端末のタスクは同じ AppProcess のまま次のアプリを実行するので，元に戻しておく．
+  // スタックはこの後でページテーブルごと片付けられる
+  task.Process()->exiting = false;
+  task.Process()->thread_stacks.clear();
+  task.Process()->free_thread_stacks.clear();
+  __asm__("sti");
+}
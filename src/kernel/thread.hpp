@@ -0,0 +1,38 @@
+/**
+ * @file thread.hpp
+ *
+ * 1 つのアプリの中で並行に動くスレッド．
+ *
+ * スレッドはそれぞれ 1 つのタスクで，作ったタスクとページテーブル，
+ * ファイル，要求時ページング領域などの AppProcess を共有する．
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
+
+class Task;
+
+/** @brief スレッドごとに割り当てるアプリ用スタックの大きさ */
+const size_t kAppThreadStackBytes = 16 * 4096;
+
+/** @brief task と同じアプリで動くスレッドを作り，そのタスク ID を返す．
+ *
+ * スレッドは entry(0, arg) として呼び出され，Exit で終了する．
+ * スタックの上下には 1 ページずつマップしない領域を挟み，溢れたらページフォールトで止める．
+ * Join されたスレッドのスタックは次に作るスレッドで使い回す．
+ */
+WithError<uint64_t> CreateAppThread(Task& task, uint64_t entry, uint64_t arg);
+
+/** @brief task が作ったスレッド thread_id の終了を待ち，終了コードを返す． */
+WithError<int> JoinAppThread(Task& task, uint64_t thread_id);
+
+/** @brief アプリ本体が終了したとき，残っているスレッドを終了させる．
+ *
+ * システムコールの途中のスレッドには終了を求め，アプリへ戻るところで終了するまで待つ．
+ * スレッドを途中で止めると，カーネルの処理が中途半端に残ってしまうため．
+ */
+void KillAppThreads(Task& task);
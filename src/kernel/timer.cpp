@@ -3,6 +3,8 @@
 #include "acpi.hpp"
 #include "interrupt.hpp"
 #include "task.hpp"
+#include "io_ring.hpp"
+#include "sysinfo.hpp"
 
 namespace {
   const uint32_t kCountMax = 0xffffffffu;
@@ -18,12 +20,15 @@ void InitializeLAPICTimer() {
   divide_config = 0b1011; // divide 1:1
   lvt_timer = 0b001 << 16; // masked, one-shot
 
+  const uint64_t tsc_start = __builtin_ia32_rdtsc();
   StartLAPICTimer();
   acpi::WaitMilliseconds(100);
   const auto elapsed = LAPICTimerElapsed();
   StopLAPICTimer();
+  const uint64_t tsc_elapsed = __builtin_ia32_rdtsc() - tsc_start;
 
   lapic_timer_freq = static_cast<unsigned long>(elapsed) * 10;
+  tsc_freq = tsc_elapsed * 10;
 
   divide_config = 0b1011; // divide 1:1
   lvt_timer = (0b010 << 16) | InterruptVector::kLAPICTimer; // not-masked, periodic
@@ -71,6 +76,17 @@ bool TimerManager::Tick() {
       continue;
     }
 
+    if (t.Value() == kRingTimerValue) {
+      CompleteRingTimers(t.TaskID(), tick_);
+      timers_.pop();
+      continue;
+    }
+    if (t.Value() == kWakeupTimerValue) {
+      task_manager->Wakeup(t.TaskID());
+      timers_.pop();
+      continue;
+    }
+
     Message m{Message::kTimerTimeout};
     m.arg.timer.timeout = t.Timeout();
     m.arg.timer.value = t.Value();
@@ -84,9 +100,11 @@ bool TimerManager::Tick() {
 
 TimerManager* timer_manager;
 unsigned long lapic_timer_freq;
+unsigned long tsc_freq;
 
 extern "C" void LAPICTimerOnInterrupt(const TaskContext& ctx_stack) {
   const bool task_timer_timeout = timer_manager->Tick();
+  UpdateSysInfoTick(timer_manager->CurrentTick());
   NotifyEndOfInterrupt();
 
   if (task_timer_timeout) {
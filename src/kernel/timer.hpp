@@ -43,7 +43,13 @@ class TimerManager {
 
 extern TimerManager* timer_manager;
 extern unsigned long lapic_timer_freq;
+/** @brief TSC の周波数（Hz）．InitializeLAPICTimer で ACPI PM タイマを基準に測る． */
+extern unsigned long tsc_freq;
 const int kTimerFreq = 100;
 
 const int kTaskTimerPeriod = static_cast<int>(kTimerFreq * 0.02);
 const int kTaskTimerValue = std::numeric_limits<int>::max();
+/** @brief I/O リングに登録された操作を完了させるためのタイマ値 */
+const int kRingTimerValue = std::numeric_limits<int>::max() - 1;
+/** @brief メッセージを送らずにタスクを起こすだけのタイマ値 */
+const int kWakeupTimerValue = std::numeric_limits<int>::max() - 2;
@@ -0,0 +1,169 @@
+/**
+ * @file virtio_blk.cpp
+ *
+ * virtio-blk（レガシーインターフェース）のドライバを実装したファイル．
+ */
+
+#include "virtio_blk.hpp"
+
+#include <cstring>
+
+#include "asmfunc.h"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+
+namespace {
+  const uint16_t kVendorVirtio = 0x1af4;
+  const uint16_t kDeviceLegacyBlock = 0x1001;
+
+  // レガシーインターフェースの I/O レジスタ（BAR0 からのオフセット）
+  const uint16_t kRegDeviceFeatures = 0x00;
+  const uint16_t kRegGuestFeatures  = 0x04;
+  const uint16_t kRegQueueAddress   = 0x08;
+  const uint16_t kRegQueueSize      = 0x0c;
+  const uint16_t kRegQueueSelect    = 0x0e;
+  const uint16_t kRegQueueNotify    = 0x10;
+  const uint16_t kRegDeviceStatus   = 0x12;
+  const uint16_t kRegCapacity       = 0x14;  // virtio-blk の設定領域
+
+  const uint8_t kStatusAcknowledge = 1;
+  const uint8_t kStatusDriver      = 2;
+  const uint8_t kStatusDriverOK    = 4;
+
+  const uint16_t kDescFlagNext  = 1;
+  const uint16_t kDescFlagWrite = 2;
+
+  const uint32_t kRequestIn  = 0;
+  const uint32_t kRequestOut = 1;
+
+  size_t Align4K(size_t bytes) {
+    return (bytes + 4095) & ~size_t{4095};
+  }
+}
+
+namespace virtio {
+
+BlockDevice::BlockDevice(const pci::Device& dev) : dev_{dev} {
+}
+
+Error BlockDevice::Initialize() {
+  auto bar = pci::ReadBar(dev_, 0);
+  if (bar.error) {
+    return bar.error;
+  }
+  if ((bar.value & 1) == 0) {
+    return MAKE_ERROR(Error::kUnknownDevice);
+  }
+  io_base_ = bar.value & ~uint64_t{3};
+
+  // I/O 空間とバスマスタを有効にする
+  pci::WriteConfReg(dev_, 0x04, pci::ReadConfReg(dev_, 0x04) | 0x05);
+
+  IoOut8(io_base_ + kRegDeviceStatus, 0);
+  IoOut8(io_base_ + kRegDeviceStatus, kStatusAcknowledge);
+  IoOut8(io_base_ + kRegDeviceStatus, kStatusAcknowledge | kStatusDriver);
+  IoIn32(io_base_ + kRegDeviceFeatures);
+  IoOut32(io_base_ + kRegGuestFeatures, 0);
+
+  IoOut16(io_base_ + kRegQueueSelect, 0);
+  queue_size_ = IoIn16(io_base_ + kRegQueueSize);
+  if (queue_size_ == 0) {
+    return MAKE_ERROR(Error::kUnknownDevice);
+  }
+
+  // レガシーの virtqueue はディスクリプタ表と available リングの後ろを
+  // 4KiB 境界に揃えて used リングを置く
+  const size_t avail_offset = 16 * queue_size_;
+  const size_t used_offset = Align4K(avail_offset + 6 + 2 * queue_size_);
+  const size_t queue_bytes = used_offset + Align4K(6 + 8 * queue_size_);
+  auto frames = memory_manager->Allocate(queue_bytes / kBytesPerFrame);
+  if (frames.error) {
+    return frames.error;
+  }
+  auto queue = reinterpret_cast<uint8_t*>(frames.value.Frame());
+  memset(queue, 0, queue_bytes);
+
+  desc_ = reinterpret_cast<VirtqDesc*>(queue);
+  avail_ = reinterpret_cast<volatile uint16_t*>(queue + avail_offset);
+  used_ = reinterpret_cast<volatile uint16_t*>(queue + used_offset);
+  last_used_idx_ = 0;
+  IoOut32(io_base_ + kRegQueueAddress, reinterpret_cast<uintptr_t>(queue) >> 12);
+
+  num_sectors_ = IoIn32(io_base_ + kRegCapacity) |
+    (static_cast<uint64_t>(IoIn32(io_base_ + kRegCapacity + 4)) << 32);
+
+  IoOut8(io_base_ + kRegDeviceStatus,
+         kStatusAcknowledge | kStatusDriver | kStatusDriverOK);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error BlockDevice::Read(uint64_t lba, void* buf, size_t num_sectors) {
+  return Submit(kRequestIn, lba, buf, num_sectors * kSectorSize);
+}
+
+Error BlockDevice::Write(uint64_t lba, const void* buf, size_t num_sectors) {
+  return Submit(kRequestOut, lba, const_cast<void*>(buf), num_sectors * kSectorSize);
+}
+
+Error BlockDevice::Submit(uint32_t type, uint64_t lba, void* buf, size_t bytes) {
+  if (lba + bytes / kSectorSize > num_sectors_) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+
+  // ページフォルト処理からも呼ばれるので，割り込み許可フラグを保存して戻す
+  uint64_t rflags;
+  __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags) :: "memory");
+
+  header_ = {type, 0, lba};
+  status_ = 0xff;
+
+  desc_[0] = {reinterpret_cast<uintptr_t>(&header_), sizeof(header_), kDescFlagNext, 1};
+  desc_[1] = {reinterpret_cast<uintptr_t>(buf), static_cast<uint32_t>(bytes),
+              static_cast<uint16_t>(kDescFlagNext | (type == kRequestIn ? kDescFlagWrite : 0)), 2};
+  desc_[2] = {reinterpret_cast<uintptr_t>(&status_), 1, kDescFlagWrite, 0};
+
+  const uint16_t avail_idx = avail_[1];
+  avail_[2 + avail_idx % queue_size_] = 0;
+  __asm__ volatile("mfence" ::: "memory");
+  avail_[1] = avail_idx + 1;
+  __asm__ volatile("mfence" ::: "memory");
+  IoOut16(io_base_ + kRegQueueNotify, 0);
+
+  while (used_[1] == last_used_idx_) {
+    __asm__ volatile("pause" ::: "memory");
+  }
+  ++last_used_idx_;
+  const uint8_t status = status_;
+
+  if (rflags & 0x200) {
+    __asm__("sti");
+  }
+
+  if (status != 0) {
+    Log(kError, "virtio-blk: request %u at %lu failed (%u)\n", type, lba, status);
+    return MAKE_ERROR(Error::kTransferFailed);
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+WithError<BlockDevice*> FindBlockDevice() {
+  for (int i = 0; i < pci::num_device; ++i) {
+    const auto& dev = pci::devices[i];
+    if (pci::ReadVendorId(dev) != kVendorVirtio ||
+        pci::ReadDeviceId(dev.bus, dev.device, dev.function) != kDeviceLegacyBlock) {
+      continue;
+    }
+
+    auto blk = new BlockDevice{dev};
+    if (auto err = blk->Initialize()) {
+      delete blk;
+      return {nullptr, err};
+    }
+    Log(kInfo, "virtio-blk: %d.%d.%d, %lu sectors\n",
+        dev.bus, dev.device, dev.function, blk->NumSectors());
+    return {blk, MAKE_ERROR(Error::kSuccess)};
+  }
+  return {nullptr, MAKE_ERROR(Error::kUnknownDevice)};
+}
+
+} // namespace virtio
@@ -0,0 +1,65 @@
+/**
+ * @file virtio_blk.hpp
+ *
+ * virtio-blk（レガシーインターフェース）のドライバ．
+ *
+ * 割り込みは使わず，要求を 1 つずつ発行して完了をポーリングで待つ．
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "block_device.hpp"
+#include "pci.hpp"
+
+namespace virtio {
+
+/** @brief virtqueue のディスクリプタ */
+struct VirtqDesc {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+} __attribute__((packed));
+
+/** @brief virtio-blk の要求ヘッダ */
+struct BlockRequestHeader {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} __attribute__((packed));
+
+class BlockDevice : public ::BlockDevice {
+ public:
+  explicit BlockDevice(const pci::Device& dev);
+  Error Initialize();
+  Error Read(uint64_t lba, void* buf, size_t num_sectors) override;
+  Error Write(uint64_t lba, const void* buf, size_t num_sectors) override;
+  uint64_t NumSectors() const override { return num_sectors_; }
+
+ private:
+  /** @brief 要求を 1 つ発行し，完了するまで待つ． */
+  Error Submit(uint32_t type, uint64_t lba, void* buf, size_t bytes);
+
+  pci::Device dev_;
+  uint16_t io_base_;
+  uint64_t num_sectors_;
+
+  uint16_t queue_size_;
+  VirtqDesc* desc_;
+  volatile uint16_t* avail_;  // flags, idx, ring[queue_size_]
+  volatile uint16_t* used_;   // flags, idx, ring[queue_size_]（各要素 8 バイト）
+  uint16_t last_used_idx_;
+
+  BlockRequestHeader header_;
+  volatile uint8_t status_;
+};
+
+/** @brief PCI デバイスから virtio-blk を探して初期化する．
+ *
+ * @return 見つかったデバイス．無ければ kUnknownDevice．
+ */
+WithError<BlockDevice*> FindBlockDevice();
+
+} // namespace virtio
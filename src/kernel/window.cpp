@@ -1,5 +1,7 @@
 #include "window.hpp"
 
+#include <cstring>
+
 #include "logger.hpp"
 #include "font.hpp"
 
@@ -43,6 +45,28 @@ namespace {
   };
 }
 
+WindowSurface::~WindowSurface() {
+  if (num_frames_ > 0) {
+    memory_manager->Free(frame_, num_frames_);
+  }
+}
+
+Error WindowSurface::Initialize(int width, int height) {
+  const size_t bytes = sizeof(uint32_t) * width * height;
+  const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+  auto [ frame, err ] = memory_manager->Allocate(num_frames);
+  if (err) {
+    return err;
+  }
+
+  width_ = width;
+  height_ = height;
+  frame_ = frame;
+  num_frames_ = num_frames;
+  memset(frame_.Frame(), 0, num_frames_ * kBytesPerFrame);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
 Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}, height_{height} {
   data_.resize(height);
   for (int y = 0; y < height; ++y) {
@@ -102,6 +126,26 @@ void Window::Write(Vector2D<int> pos, PixelColor c) {
   shadow_buffer_.Writer().Write(pos, c);
 }
 
+void Window::WriteLine(Vector2D<int> pos, const uint32_t* pixels, int n) {
+  auto& data_line = data_[pos.y];
+  for (int i = 0; i < n; ++i) {
+    data_line[pos.x + i] = ToColor(pixels[i]);
+  }
+
+  // 0x00RRGGBB の画素はメモリ上で B, G, R, 予約の順に並ぶ
+  const auto& shadow = shadow_buffer_.Config();
+  uint8_t* dst = shadow.frame_buffer + 4 * (shadow.pixels_per_scan_line * pos.y + pos.x);
+  if (shadow.pixel_format == kPixelBGRResv8BitPerColor) {
+    memcpy(dst, pixels, 4 * n);
+    return;
+  }
+  for (int i = 0; i < n; ++i) {
+    dst[4 * i + 0] = pixels[i] >> 16;
+    dst[4 * i + 1] = pixels[i] >> 8;
+    dst[4 * i + 2] = pixels[i];
+  }
+}
+
 int Window::Width() const {
   return width_;
 }
@@ -118,6 +162,26 @@ void Window::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
   shadow_buffer_.Move(dst_pos, src);
 }
 
+void Window::AttachSurface(std::unique_ptr<WindowSurface> surface, Vector2D<int> pos) {
+  surface_ = std::move(surface);
+  surface_pos_ = pos;
+}
+
+Rectangle<int> Window::CommitSurface(const Rectangle<int>& area) {
+  if (!surface_) {
+    return {{0, 0}, {0, 0}};
+  }
+
+  const Rectangle<int> surface_area{{0, 0}, {surface_->Width(), surface_->Height()}};
+  const auto src = area & surface_area;
+  const uint32_t* pixels = surface_->Pixels();
+  for (int y = src.pos.y; y < src.pos.y + src.size.y; ++y) {
+    WriteLine(surface_pos_ + Vector2D<int>{src.pos.x, y},
+              &pixels[y * surface_->Width() + src.pos.x], src.size.x);
+  }
+  return {surface_pos_ + src.pos, src.size};
+}
+
 WindowRegion Window::GetWindowRegion(Vector2D<int> pos) {
   return WindowRegion::kOther;
 }
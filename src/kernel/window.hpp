@@ -7,10 +7,13 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <optional>
 #include <string>
+#include "error.hpp"
 #include "graphics.hpp"
 #include "frame_buffer.hpp"
+#include "memory_manager.hpp"
 
 enum class WindowRegion {
   kTitleBar,
@@ -19,6 +22,38 @@ enum class WindowRegion {
   kOther,
 };
 
+/** @brief WindowSurface はアプリのアドレス空間へ直接マップされる描画面を表す。
+ *
+ * 画素は 1 画素 32 ビットの 0x00RRGGBB 形式で，行の間に隙間はない。
+ * 物理的に連続したフレームに確保されるため，カーネルからはアイデンティティマップを
+ * 通してそのまま参照できる。
+ */
+class WindowSurface {
+ public:
+  WindowSurface() = default;
+  ~WindowSurface();
+  WindowSurface(const WindowSurface&) = delete;
+  WindowSurface& operator=(const WindowSurface&) = delete;
+
+  /** @brief 指定されたピクセル数の描画面のためにフレームを確保する。 */
+  Error Initialize(int width, int height);
+
+  uint32_t* Pixels() const { return reinterpret_cast<uint32_t*>(frame_.Frame()); }
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+  size_t NumFrames() const { return num_frames_; }
+
+  /** @brief アプリのアドレス空間でこの描画面がマップされている仮想アドレス */
+  uint64_t AppAddress() const { return app_addr_; }
+  void SetAppAddress(uint64_t addr) { app_addr_ = addr; }
+
+ private:
+  int width_{0}, height_{0};
+  FrameID frame_{kNullFrame};
+  size_t num_frames_{0};
+  uint64_t app_addr_{0};
+};
+
 /** @brief Window クラスはグラフィックの表示領域を表す。
  *
  * タイトルやメニューがあるウィンドウだけでなく，マウスカーソルの表示領域なども対象とする。
@@ -58,6 +93,8 @@ class Window {
   void DrawTo(FrameBuffer& dst, Vector2D<int> pos, const Rectangle<int>& area);
   /** @brief 透過色を設定する。 */
   void SetTransparentColor(std::optional<PixelColor> c);
+  /** @brief 透過色が設定されていれば true を返す。 */
+  bool HasTransparentColor() const { return transparent_color_.has_value(); }
   /** @brief このインスタンスに紐付いた WindowWriter を取得する。 */
   WindowWriter* Writer();
 
@@ -65,6 +102,11 @@ class Window {
   const PixelColor& At(Vector2D<int> pos) const;
   /** @brief 指定した位置にピクセルを書き込む。 */
   void Write(Vector2D<int> pos, PixelColor c);
+  /** @brief pos から右へ n 個のピクセル（0x00RRGGBB）を 1 行分まとめて書き込む。
+   *
+   * 範囲はウィンドウ内に収まっていること。
+   */
+  void WriteLine(Vector2D<int> pos, const uint32_t* pixels, int n);
 
   /** @brief 平面描画領域の横幅をピクセル単位で返す。 */
   int Width() const;
@@ -81,6 +123,23 @@ class Window {
    */
   void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
 
+  /** @brief 描画面を関連付ける。
+   *
+   * @param surface  関連付ける描画面
+   * @param pos  ウィンドウの左上を基準とした描画面の位置
+   */
+  void AttachSurface(std::unique_ptr<WindowSurface> surface, Vector2D<int> pos);
+  /** @brief 関連付けられた描画面を返す。なければ nullptr。 */
+  WindowSurface* Surface() const { return surface_.get(); }
+  /** @brief 描画面の位置（ウィンドウの左上基準）を返す。 */
+  Vector2D<int> SurfacePosition() const { return surface_pos_; }
+  /** @brief 描画面の指定範囲の内容をウィンドウに反映する。
+   *
+   * @param area  描画面の左上を基準とした反映範囲
+   * @return 実際に反映した範囲（ウィンドウの左上基準）
+   */
+  Rectangle<int> CommitSurface(const Rectangle<int>& area);
+
   virtual void Activate() {}
   virtual void Deactivate() {}
   virtual WindowRegion GetWindowRegion(Vector2D<int> pos);
@@ -92,6 +151,9 @@ class Window {
   std::optional<PixelColor> transparent_color_{std::nullopt};
 
   FrameBuffer shadow_buffer_{};
+
+  std::unique_ptr<WindowSurface> surface_{};
+  Vector2D<int> surface_pos_{0, 0};
 };
 
 class ToplevelWindow : public Window {